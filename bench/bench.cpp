@@ -0,0 +1,249 @@
+/*
+ * bench.cpp
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#include "config.h"
+#include "CDDB.h"
+#include "CDDBParser.h"
+#include "Context.h"
+#include "Dir.h"
+#include "EncodingDetector.h"
+#include "File.h"
+#include "MusicFileCreator.h"
+#include "Options.h"
+#include "Tracer.h"
+#include "TrackInfo.h"
+#include "Utf8Converter.h"
+
+using FMF::CDDB;
+using FMF::CDDBParser;
+using FMF::Context;
+using FMF::Dir;
+using FMF::EncodingDetector;
+using FMF::File;
+using FMF::MusicFileCreator;
+using FMF::Options;
+using FMF::Tracer;
+using FMF::TrackInfo;
+using FMF::Utf8Converter;
+
+#include <ftw.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * micro benchmarks of the hot paths of fmf.
+ *
+ * each benchmark runs for at least MIN_TIME and outputs one json object per line:
+ * {"name":"...","iterations":N,"ns_per_op":X,"ops_per_sec":Y}
+ */
+namespace {
+
+const std::chrono::milliseconds MIN_TIME(500);
+
+/**
+ * collects the paths of cddb files from the genre sub directories of a cddb dir
+ */
+struct CorpusScanner: Dir::DirScanHandler {
+	std::vector<std::string> files;
+
+	virtual void on_dir_begin(const Dir&) {
+	}
+
+	virtual Dir::EachResult on_dir_entry(const Dir& dir, const dirent& de) {
+		if (de.d_type == DT_DIR) {
+			Dir sub_dir = dir.sub_dir(de.d_name);
+			sub_dir.for_each(*this);
+		}
+		else {
+			files.push_back(dir.path() + Dir::DIR_SEP + de.d_name);
+		}
+		return Dir::EachResult::CONTINUE;
+	}
+
+	virtual void on_dir_end(const Dir&) {
+	}
+};
+
+/**
+ * discards everything written to std::cout while in scope
+ */
+struct CoutSilencer {
+	CoutSilencer() :
+			m_buf(std::cout.rdbuf(nullptr)) {
+	}
+	~CoutSilencer() {
+		std::cout.rdbuf(m_buf);
+	}
+private:
+	std::streambuf* m_buf;
+};
+
+template<typename F>
+void bench(const char* name, F fn) {
+	typedef std::chrono::steady_clock clock;
+	size_t iterations = 0;
+	clock::duration elapsed;
+	{
+		CoutSilencer silence;
+		fn(); // warm up
+		size_t batch = 1;
+		auto start = clock::now();
+		do {
+			for (size_t i = 0; i < batch; i++) {
+				fn();
+			}
+			iterations += batch;
+			batch *= 2;
+			elapsed = clock::now() - start;
+		} while (elapsed < MIN_TIME);
+	}
+	double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+	char line[256];
+	::snprintf(line, sizeof(line), "{\"name\":\"%s\",\"iterations\":%zu,\"ns_per_op\":%.1f,\"ops_per_sec\":%.1f}", name,
+			iterations, ns / iterations, iterations * 1e9 / ns);
+	std::cout << line << std::endl;
+}
+
+int remove_entry(const char* path, const struct stat*, int, struct FTW*) {
+	return ::remove(path);
+}
+
+} /* namespace */
+
+int main(int argc, char** argv) {
+	if (argc != 4) {
+		std::cerr << "Usage: " << argv[0] << " <corpus dir> <template music file> <tmp dir>" << std::endl;
+		return EXIT_FAILURE;
+	}
+	const std::string corpus_dir = argv[1];
+	const std::string template_file = argv[2];
+	const std::string work_dir = std::string(argv[3]) + Dir::DIR_SEP + "fmf-bench." + std::to_string(::getpid());
+	const std::string out_dir = work_dir + Dir::DIR_SEP + "out";
+	const std::string cache_dir = work_dir + Dir::DIR_SEP + "cache";
+
+	CorpusScanner corpus;
+	Dir(corpus_dir).for_each(corpus);
+	if (corpus.files.empty()) {
+		std::cerr << "no cddb files in corpus dir " << corpus_dir << std::endl;
+		return EXIT_FAILURE;
+	}
+	Dir(work_dir).create();
+	Dir(out_dir).create();
+
+	// options for the context of the parser and creator
+	std::vector<std::string> args { argv[0], "-i", corpus.files[0], "-o", out_dir, "-t", template_file };
+	std::vector<char*> opts_argv;
+	for (auto& arg : args) {
+		opts_argv.push_back(&arg[0]);
+	}
+	Options opts;
+	if (!opts.parse(opts_argv.size(), &opts_argv[0]))
+		return EXIT_FAILURE;
+	Context ctx(opts);
+	if (!ctx.init())
+		return EXIT_FAILURE;
+
+	std::cout << "{\"fmf\":\"" << PACKAGE_VERSION << "\",\"corpus_files\":" << corpus.files.size() << "}" << std::endl;
+
+	std::vector<std::string> contents;
+	for (auto& path : corpus.files) {
+		contents.push_back(File(path).read_all());
+	}
+
+	size_t n = 0;
+	CDDBParser parser(ctx);
+	bench("CDDBParser::parse", [&]() {
+		parser.parse(corpus.files[n++ % corpus.files.size()]);
+	});
+
+	n = 0;
+	EncodingDetector detector;
+	bench("EncodingDetector::detect+Utf8Converter::convert", [&]() {
+		std::string text = contents[n++ % contents.size()];
+		Utf8Converter conv(detector.detect(text));
+		conv.convert(text);
+	});
+
+	{
+		CoutSilencer silence;
+		CDDB cddb(corpus_dir, cache_dir, "cddb.cache");
+		if (!cddb.init(true))
+			return EXIT_FAILURE;
+	}
+	bench("CDDB::init(cache load)", [&]() {
+		CDDB cddb(corpus_dir, cache_dir, "cddb.cache");
+		cddb.init();
+	});
+
+	CDDB cddb(corpus_dir, cache_dir, "cddb.cache");
+	{
+		CoutSilencer silence;
+		cddb.init();
+	}
+	bench("CDDB::random_file", [&]() {
+		cddb.random_file();
+	});
+
+	std::vector<TrackInfo> tracks;
+	for (auto& path : corpus.files) {
+		if (parser.parse(path)) {
+			auto album = parser.getTracks();
+			tracks.insert(tracks.end(), album.begin(), album.end());
+		}
+	}
+	if (tracks.empty()) {
+		std::cerr << "no track parsed from the cddb files in corpus dir " << corpus_dir << std::endl;
+		::nftw(work_dir.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+		return EXIT_FAILURE;
+	}
+
+	n = 0;
+	bench("Dir::path_escape", [&]() {
+		Dir::path_escape(tracks[n++ % tracks.size()].title());
+	});
+
+	MusicFileCreator creator(ctx);
+	if (!creator.init())
+		return EXIT_FAILURE;
+
+	n = 0;
+	bench("MusicFileCreator::make_file_name", [&]() {
+		creator.make_file_name(tracks[n++ % tracks.size()]);
+	});
+
+	n = 0;
+	MusicFileCreator::Session session(creator);
+	bench("MusicFileCreator::create_music_file", [&]() {
+		// unique titles so no file is skipped as existing
+		TrackInfo ti = tracks[n % tracks.size()];
+		ti.set_title(ti.title() + " " + std::to_string(n++));
+		creator.create_music_file(ti, session);
+	});
+
+	::nftw(work_dir.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,119 @@
+/*
+ * engine.cpp
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#include "Engine.h"
+#include "MusicFileSink.h"
+
+using FMF::CallbackSink;
+using FMF::Engine;
+using FMF::MemorySink;
+using FMF::NullSink;
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * example and check of libfmf: opens an Engine once, then runs several generate() calls into a MemorySink, a
+ * CallbackSink and a NullSink.
+ *
+ * outputs one line per check, "ok <check>" or "FAIL <check>", and exits with failure if a check failed.
+ */
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& name) {
+	std::cout << (ok ? "ok " : "FAIL ") << name << std::endl;
+	if (!ok) {
+		failures++;
+	}
+}
+
+} /* namespace */
+
+int main(int argc, char** argv) {
+	if (argc != 2) {
+		std::cerr << "Usage: " << argv[0] << " <template music file>" << std::endl;
+		return EXIT_FAILURE;
+	}
+	const std::string template_file = argv[1];
+
+	Engine engine;
+	if (!engine.open( { "--synthetic", "-t", template_file, "-c", "2" })) {
+		std::cerr << "failed to open the engine" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// the same seed generates the same files, every run starts over
+	MemorySink memory;
+	Engine::Results results;
+	check(engine.generate(Engine::Run(3, 42), memory, results), "MemorySink run");
+	const auto files = memory.files();
+	check(!files.empty() && files.size() == results.created, "MemorySink files are the created files");
+	uint64_t bytes = 0;
+	bool all_tagged = true;
+	for (auto& file : files) {
+		bytes += file.second.size();
+		all_tagged = all_tagged && !file.second.empty();
+	}
+	check(all_tagged && bytes == results.bytes, "MemorySink bytes are the written bytes");
+
+	memory.clear();
+	check(engine.generate(Engine::Run(3, 42), memory, results), "MemorySink run again");
+	check(memory.files() == files, "MemorySink run with the same seed has the same files");
+
+	memory.clear();
+	check(engine.generate(Engine::Run(3, 43), memory, results), "MemorySink run with another seed");
+	check(memory.files() != files, "MemorySink run with another seed has other files");
+
+	std::atomic<size_t> callbacks(0);
+	std::atomic<uint64_t> callback_bytes(0);
+	CallbackSink callback([&](const std::string&, std::string&& data) {
+		callbacks++;
+		callback_bytes += data.size();
+		return true;
+	});
+	check(engine.generate(Engine::Run(3, 42), callback, results), "CallbackSink run");
+	check(callbacks == files.size() && callback_bytes == bytes, "CallbackSink gets the files of the MemorySink");
+
+	CallbackSink failing([](const std::string&, std::string&&) {
+		return false;
+	});
+	engine.generate(Engine::Run(1, 42), failing, results);
+	check(results.created == 0 && results.failed > 0, "CallbackSink failed files are counted as failed");
+
+	NullSink null;
+	check(engine.generate(Engine::Run(5, 7), null, results), "NullSink run");
+	check(null.files() == results.created && null.bytes() == results.bytes, "NullSink counts the created files");
+
+	Engine sparse;
+	if (sparse.open( { "--synthetic", "-t", template_file, "--sparse", "1M" })) {
+		check(!sparse.generate(Engine::Run(1, 42), null, results), "sink run refused with --sparse");
+	}
+	else {
+		check(false, "open with --sparse");
+	}
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,275 @@
+/*
+ * AlbumIndex.cpp
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#include "AlbumIndex.h"
+#include "Bitmap.h"
+
+#include <string.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace FMF {
+
+/// "FMFA" and the version of the format
+static const uint32_t MAGIC = 0x41464D46;
+static const uint32_t VERSION = 1;
+
+static const size_t NO_LIMIT = std::numeric_limits<size_t>::max();
+
+template<typename T>
+static void write_value(std::ostream& os, const T& value) {
+	os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template<typename T>
+static bool read_value(std::istream& is, T& value) {
+	return static_cast<bool>(is.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+template<typename T>
+static void write_column(std::ostream& os, const std::vector<T>& column) {
+	os.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(T));
+}
+
+template<typename T>
+static bool read_column(std::istream& is, std::vector<T>& column, size_t size) {
+	column.resize(size);
+	return static_cast<bool>(is.read(reinterpret_cast<char*>(column.data()), size * sizeof(T)));
+}
+
+static bool starts_with(const std::string& line, const char* prefix, size_t len) {
+	return 0 == line.compare(0, len, prefix);
+}
+
+/**
+ * @return fnv-1a hash of the ascii letters and digits of @e s in lower case, the bytes >= 0x80 and the characters
+ * in @e keep. 0 if there are none.
+ */
+static uint64_t normalized_hash(const std::string& s, const char* keep) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	bool empty = true;
+	for (unsigned char c : s) {
+		if (c < 0x80 && !std::isalnum(c) && !(c && ::strchr(keep, c)))
+			continue;
+		hash = (hash ^ (c < 0x80 ? std::tolower(c) : c)) * 0x100000001b3ULL;
+		empty = false;
+	}
+	return empty ? 0 : hash;
+}
+
+//-----------------------------------------------------------------------------
+// AlbumIndex::Album
+//-----------------------------------------------------------------------------
+AlbumIndex::Album::Album() :
+		key(0), dgenre(0), year(0), tracks(0), initial(0) {
+}
+
+//-----------------------------------------------------------------------------
+// AlbumIndex::Filter
+//-----------------------------------------------------------------------------
+AlbumIndex::Filter::Filter() :
+		min_year(0), max_year(NO_LIMIT), min_tracks(0), max_tracks(NO_LIMIT), initials(), dgenres(), dgenre_names() {
+}
+
+bool AlbumIndex::Filter::is_set() const {
+	return min_year > 0 || max_year != NO_LIMIT || min_tracks > 0 || max_tracks != NO_LIMIT || !initials.empty()
+			|| !dgenres.empty();
+}
+
+bool AlbumIndex::Filter::parse_initials(const std::string& spec) {
+	std::istringstream is(spec);
+	std::string item;
+	while (std::getline(is, item, ',')) {
+		const bool range = item.size() == 3 && item[1] == '-';
+		if (!(item.size() == 1 || range))
+			return false;
+		const unsigned char first = std::tolower(item[0]);
+		const unsigned char last = std::tolower(item[range ? 2 : 0]);
+		if (!std::isalnum(first) || !std::isalnum(last) || first > last || !std::isalpha(first) != !std::isalpha(last))
+			return false;
+		for (unsigned c = first; c <= last; c++) {
+			if (initials.find(c) == std::string::npos) {
+				initials.push_back(c);
+			}
+		}
+	}
+	return !initials.empty();
+}
+
+bool AlbumIndex::Filter::parse_dgenres(const std::string& spec) {
+	std::istringstream is(spec);
+	std::string item;
+	while (std::getline(is, item, ',')) {
+		if (!normalized_hash(item, ""))
+			return false;
+		dgenres.push_back(dgenre_hash(item));
+		dgenre_names.push_back(item);
+	}
+	return !dgenres.empty();
+}
+
+std::ostream& operator<<(std::ostream& os, const AlbumIndex::Filter& filter) {
+	if (filter.min_year > 0 || filter.max_year != NO_LIMIT) {
+		os << " year=" << filter.min_year << "-";
+		if (filter.max_year != NO_LIMIT) {
+			os << filter.max_year;
+		}
+	}
+	if (filter.min_tracks > 0 || filter.max_tracks != NO_LIMIT) {
+		os << " tracks=" << filter.min_tracks << "-";
+		if (filter.max_tracks != NO_LIMIT) {
+			os << filter.max_tracks;
+		}
+	}
+	if (!filter.initials.empty()) {
+		os << " initials=" << filter.initials;
+	}
+	for (size_t i = 0; i < filter.dgenre_names.size(); i++) {
+		os << (i ? "," : " dgenre=") << filter.dgenre_names[i];
+	}
+	return os;
+}
+
+//-----------------------------------------------------------------------------
+// AlbumIndex
+//-----------------------------------------------------------------------------
+AlbumIndex::AlbumIndex() :
+		m_years(), m_tracks(), m_initials(), m_dgenres() {
+}
+
+AlbumIndex::~AlbumIndex() {
+}
+
+void AlbumIndex::reset(size_t size) {
+	m_years.assign(size, 0);
+	m_tracks.assign(size, 0);
+	m_initials.assign(size, 0);
+	m_dgenres.assign(size, 0);
+}
+
+void AlbumIndex::set(size_t index, const Album& album) {
+	m_years[index] = album.year;
+	m_tracks[index] = album.tracks;
+	m_initials[index] = album.initial;
+	m_dgenres[index] = album.dgenre;
+}
+
+size_t AlbumIndex::bytes() const {
+	return size() * (sizeof(uint16_t) + sizeof(uint8_t) + sizeof(char) + sizeof(uint32_t));
+}
+
+void AlbumIndex::select(const Filter& filter, const Bitmap* excluded, std::vector<uint32_t>& indexes) const {
+	bool initials[256] = { };
+	for (unsigned char c : filter.initials) {
+		initials[c] = true;
+	}
+	for (size_t i = 0; i < size(); i++) {
+		if ((excluded && excluded->test(i)) || m_years[i] < filter.min_year || m_years[i] > filter.max_year
+				|| m_tracks[i] < filter.min_tracks || m_tracks[i] > filter.max_tracks)
+			continue;
+		if (!filter.initials.empty() && !initials[static_cast<unsigned char>(m_initials[i])])
+			continue;
+		if (!filter.dgenres.empty()
+				&& std::find(filter.dgenres.begin(), filter.dgenres.end(), m_dgenres[i]) == filter.dgenres.end())
+			continue;
+		indexes.push_back(i);
+	}
+}
+
+bool AlbumIndex::read(std::istream& is, size_t size) {
+	uint32_t magic, version, num_albums;
+	if (!read_value(is, magic) || magic != MAGIC || !read_value(is, version) || version != VERSION
+			|| !read_value(is, num_albums) || num_albums != size)
+		return false;
+	if (read_column(is, m_years, size) && read_column(is, m_tracks, size) && read_column(is, m_initials, size)
+			&& read_column(is, m_dgenres, size))
+		return true;
+	reset(0);
+	return false;
+}
+
+void AlbumIndex::write(std::ostream& os) const {
+	const uint32_t num_albums = size();
+	write_value(os, MAGIC);
+	write_value(os, VERSION);
+	write_value(os, num_albums);
+	write_column(os, m_years);
+	write_column(os, m_tracks);
+	write_column(os, m_initials);
+	write_column(os, m_dgenres);
+}
+
+/*static*/bool AlbumIndex::read_album(const std::string& path, Album& album) {
+	std::ifstream is(path, std::ios::in | std::ios::binary);
+	if (!is)
+		return false;
+	album = Album();
+	std::string line;
+	std::string dtitle;
+	std::string dgenre;
+	size_t tracks = 0;
+	while (std::getline(is, line)) {
+		// a long value is continued on the following lines of the same keyword
+		if (starts_with(line, "DTITLE=", 7)) {
+			dtitle.append(line, 7, std::string::npos);
+		}
+		else if (starts_with(line, "DGENRE=", 7)) {
+			dgenre.append(line, 7, std::string::npos);
+		}
+		else if (starts_with(line, "DYEAR=", 6)) {
+			const unsigned long year = ::strtoul(line.c_str() + 6, nullptr, 10);
+			album.year = year < 10000 ? year : 0;
+		}
+		else if (starts_with(line, "TTITLE", 6)) {
+			char* end = nullptr;
+			const unsigned long track = ::strtoul(line.c_str() + 6, &end, 10);
+			if (end != line.c_str() + 6 && *end == '=') {
+				tracks = std::max<size_t>(tracks, track + 1);
+			}
+		}
+		else if (starts_with(line, "EXTD=", 5)) {
+			// the extended data follows the track titles
+			break;
+		}
+	}
+	album.key = normalized_hash(dtitle, "/");
+	album.dgenre = normalized_hash(dgenre, "") ? dgenre_hash(dgenre) : 0;
+	album.tracks = std::min<size_t>(tracks, std::numeric_limits<uint8_t>::max());
+	for (unsigned char c : dtitle.substr(0, dtitle.find(" / "))) {
+		if (c >= 0x80 || std::isalnum(c)) {
+			album.initial = c < 0x80 ? std::tolower(c) : 0;
+			break;
+		}
+	}
+	return true;
+}
+
+/*static*/uint32_t AlbumIndex::dgenre_hash(const std::string& dgenre) {
+	const uint64_t hash = normalized_hash(dgenre, "");
+	const uint32_t folded = hash ^ (hash >> 32);
+	return folded ? folded : 1;
+}
+
+} /* namespace FMF */
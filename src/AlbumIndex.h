@@ -0,0 +1,148 @@
+/*
+ * AlbumIndex.h
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#ifndef ALBUMINDEX_H_
+#define ALBUMINDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace FMF {
+
+class Bitmap;
+
+/**
+ * year, number of tracks, artist initial and DGENRE of the cddb files of a genre, by index of the genre's DiscIdList.
+ *
+ * each attribute is kept in its own column, so the files matching a Filter are selected once by scanning the
+ * columns, without reading the cddb files. DGENRE is free text, it is kept as a hash of its letters and digits.
+ */
+class AlbumIndex {
+public:
+	/**
+	 * the metadata of one cddb file, read by read_album()
+	 */
+	struct Album {
+		Album();
+
+		/// hash of the artist and title of DTITLE ignoring case, spaces and punctuation, 0 if there is no DTITLE
+		uint64_t key;
+		/// dgenre_hash() of DGENRE, 0 if there is no DGENRE
+		uint32_t dgenre;
+		/// DYEAR, 0 if unknown
+		uint16_t year;
+		uint8_t tracks;
+		/// first letter or digit of the artist in lower case, 0 if it is not ascii
+		char initial;
+	};
+
+	/**
+	 * the albums to pick, set by options --year, --min-tracks, --max-tracks, --artist-initial and --dgenre
+	 */
+	struct Filter {
+		Filter();
+
+		bool is_set() const;
+
+		/**
+		 * parse a list of letters, digits and ranges of them: <c>|<first>-<last>[,...] e.g. a-c,x
+		 *
+		 * @return false if @e spec is invalid
+		 */
+		bool parse_initials(const std::string& spec);
+
+		/**
+		 * parse a comma separated list of DGENRE values, matched ignoring case, spaces and punctuation
+		 *
+		 * @return false if @e spec has an empty value
+		 */
+		bool parse_dgenres(const std::string& spec);
+
+		size_t min_year;
+		size_t max_year;
+		size_t min_tracks;
+		size_t max_tracks;
+		/// lower case artist initials, any if empty
+		std::string initials;
+		/// dgenre_hash() of the DGENRE values, any if empty
+		std::vector<uint32_t> dgenres;
+		std::vector<std::string> dgenre_names;
+	};
+
+	AlbumIndex();
+	~AlbumIndex();
+
+	/**
+	 * clear the index and resize it to @e size albums of unknown metadata
+	 */
+	void reset(size_t size);
+
+	void set(size_t index, const Album& album);
+
+	size_t size() const {
+		return m_years.size();
+	}
+
+	/**
+	 * @return size of the columns in bytes
+	 */
+	size_t bytes() const;
+
+	/**
+	 * append the indexes of the albums that match @e filter, and are not set in @e excluded if not null, to @e indexes
+	 */
+	void select(const Filter& filter, const Bitmap* excluded, std::vector<uint32_t>& indexes) const;
+
+	/**
+	 * read the index written by write()
+	 *
+	 * @return false if the data is not an index of this format of @e size albums
+	 */
+	bool read(std::istream& is, size_t size);
+
+	void write(std::ostream& os) const;
+
+	/**
+	 * read the DTITLE, DYEAR, DGENRE and TTITLE lines of cddb file @e path
+	 *
+	 * @return false if the file could not be read
+	 */
+	static bool read_album(const std::string& path, Album& album);
+
+	/**
+	 * @return hash of the letters and digits of @e dgenre ignoring case, never 0
+	 */
+	static uint32_t dgenre_hash(const std::string& dgenre);
+
+private:
+	std::vector<uint16_t> m_years;
+	std::vector<uint8_t> m_tracks;
+	std::vector<char> m_initials;
+	std::vector<uint32_t> m_dgenres;
+};
+
+std::ostream& operator<<(std::ostream& os, const AlbumIndex::Filter& filter);
+
+} /* namespace FMF */
+#endif /* ALBUMINDEX_H_ */
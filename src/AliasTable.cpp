@@ -0,0 +1,80 @@
+/*
+ * AliasTable.cpp
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#include "AliasTable.h"
+
+#include <numeric>
+
+namespace FMF {
+
+AliasTable::AliasTable() :
+		m_prob(), m_alias() {
+}
+
+bool AliasTable::init(const std::vector<double>& weights) {
+	m_prob.clear();
+	m_alias.clear();
+
+	const size_t n = weights.size();
+	const double sum = std::accumulate(weights.begin(), weights.end(), 0.0);
+	if (!n || sum <= 0)
+		return false;
+
+	m_prob.resize(n);
+	m_alias.resize(n);
+
+	// scale weights so the average column is 1
+	std::vector<double> scaled(n);
+	std::vector<size_t> small, large;
+	size_t positive = 0;
+	for (size_t i = 0; i < n; i++) {
+		scaled[i] = (weights[i] > 0 ? weights[i] : 0) * n / sum;
+		(scaled[i] < 1 ? small : large).push_back(i);
+		if (scaled[i] > 0)
+			positive = i;
+	}
+
+	// fill each under full column with the excess of an over full one
+	while (!small.empty() && !large.empty()) {
+		size_t s = small.back(), l = large.back();
+		small.pop_back();
+		m_prob[s] = scaled[s];
+		m_alias[s] = l;
+		scaled[l] = (scaled[l] + scaled[s]) - 1;
+		if (scaled[l] < 1) {
+			large.pop_back();
+			small.push_back(l);
+		}
+	}
+
+	// leftovers are full columns up to rounding errors
+	for (size_t i : large) {
+		m_prob[i] = 1;
+		m_alias[i] = i;
+	}
+	for (size_t i : small) {
+		m_prob[i] = (scaled[i] > 0 ? 1 : 0);
+		m_alias[i] = (scaled[i] > 0 ? i : positive);
+	}
+	return true;
+}
+
+} /* namespace FMF */
@@ -0,0 +1,74 @@
+/*
+ * AliasTable.h
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#ifndef ALIASTABLE_H_
+#define ALIASTABLE_H_
+
+#include <stddef.h>
+#include <random>
+#include <vector>
+
+namespace FMF {
+
+/**
+ * weighted random sampling of indexes [0, n) in O(1) per sample (Walker/Vose alias method).
+ *
+ * the table is built once from the weights, each sample then costs a single uniform draw.
+ */
+class AliasTable {
+public:
+	AliasTable();
+
+	/**
+	 * build the table for @e weights
+	 *
+	 * @param weights  non negative weight per index
+	 *
+	 * @return false if there are no weights or all of them are 0
+	 */
+	bool init(const std::vector<double>& weights);
+
+	size_t size() const {
+		return m_prob.size();
+	}
+
+	/**
+	 * @return random index in [0, size()) with probability proportional to its weight.
+	 * safe to call from several threads, each with its own @e rand
+	 */
+	template<typename Generator>
+	size_t operator()(Generator& rand) const {
+		// integer part selects the column, fraction part decides between column and its alias
+		std::uniform_real_distribution<double> random_dist(0, m_prob.size());
+		const double u = random_dist(rand);
+		size_t i = static_cast<size_t>(u);
+		if (i >= m_prob.size())
+			i = m_prob.size() - 1;
+		return (u - i) < m_prob[i] ? i : m_alias[i];
+	}
+
+private:
+	std::vector<double> m_prob;
+	std::vector<size_t> m_alias;
+};
+
+} /* namespace FMF */
+#endif /* ALIASTABLE_H_ */
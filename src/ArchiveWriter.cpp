@@ -0,0 +1,204 @@
+/*
+ * ArchiveWriter.cpp
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#include "ArchiveWriter.h"
+#include "File.h"
+#include "Tracer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+namespace FMF {
+
+/*static*/const char* const ArchiveWriter::STDOUT_PATH = "-";
+/*static*/const size_t ArchiveWriter::BLOCK_SIZE;
+/*static*/const size_t ArchiveWriter::NAME_SIZE;
+/*static*/const size_t ArchiveWriter::MAX_QUEUED_BYTES;
+
+static const char s_zeros[1024] = { };
+
+static size_t pad_size(size_t size, size_t block_size) {
+	return (block_size - size % block_size) % block_size;
+}
+
+/**
+ * @return pax record "<length> <key>=<value>\n", the length includes itself
+ */
+static std::string pax_record(const char* key, const std::string& value) {
+	const std::string record = std::string(" ") + key + "=" + value + "\n";
+	size_t len = record.size();
+	while (std::to_string(len).size() + record.size() != len) {
+		len = std::to_string(len).size() + record.size();
+	}
+	return std::to_string(len) + record;
+}
+
+static bool is_non_ascii(char c) {
+	return static_cast<unsigned char>(c) >= 0x80;
+}
+
+/**
+ * @return @e name with non ascii bytes replaced, for the ustar name of an entry with a pax path
+ */
+static std::string ascii_name(const std::string& name, size_t max_len) {
+	std::string ascii = name.substr(0, max_len);
+	std::replace_if(ascii.begin(), ascii.end(), is_non_ascii, '_');
+	return ascii;
+}
+
+ArchiveWriter::ArchiveWriter(const std::string& path) :
+		m_path(path), m_fd(-1), m_mtime(0), m_thread(), m_mutex(), m_not_empty(), m_not_full(), m_queue(), m_queued_bytes(
+				0), m_closing(false), m_failed(false), m_error(0) {
+}
+
+ArchiveWriter::~ArchiveWriter() {
+	close();
+}
+
+bool ArchiveWriter::open() {
+	if (m_path == STDOUT_PATH) {
+		if (::isatty(STDOUT_FILENO)) {
+			Tracer::_err("not writing the archive to a terminal, redirect stdout");
+			return false;
+		}
+		m_fd = STDOUT_FILENO;
+	}
+	else {
+		m_fd = ::open(m_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+		if (m_fd < 0) {
+			Tracer::_err("failed to create archive ", m_path, ": ", ::strerror(errno));
+			return false;
+		}
+	}
+	m_mtime = ::time(nullptr);
+	m_thread = std::thread(&ArchiveWriter::write_entries, this);
+	return true;
+}
+
+bool ArchiveWriter::add(const std::string& name, std::string&& data) {
+	const size_t size = data.size();
+	{
+		std::unique_lock < std::mutex > lock(m_mutex);
+		// a file larger than the queue is queued alone
+		m_not_full.wait(lock, [this, size] {return m_queued_bytes == 0 || m_queued_bytes + size <= MAX_QUEUED_BYTES;});
+		m_queued_bytes += size;
+		m_queue.push_back(Entry { name, std::move(data) });
+	}
+	m_not_empty.notify_one();
+	return !m_failed;
+}
+
+bool ArchiveWriter::close() {
+	if (!m_thread.joinable())
+		return !m_failed;
+	{
+		std::lock_guard < std::mutex > lock(m_mutex);
+		m_closing = true;
+	}
+	m_not_empty.notify_one();
+	m_thread.join();
+
+	if (!m_failed) {
+		std::vector<iovec> iov { { const_cast<char*>(s_zeros), sizeof(s_zeros) } };
+		if (!File::write_all(m_fd, iov)) {
+			m_error = errno;
+			m_failed = true;
+		}
+	}
+	if (m_fd != STDOUT_FILENO && ::close(m_fd) && !m_failed) {
+		m_error = errno;
+		m_failed = true;
+	}
+	m_fd = -1;
+	if (m_failed) {
+		Tracer::_err("failed to write archive ", m_path, ": ", ::strerror(m_error));
+	}
+	return !m_failed;
+}
+
+void ArchiveWriter::write_entries() {
+	while (true) {
+		Entry entry;
+		{
+			std::unique_lock < std::mutex > lock(m_mutex);
+			m_not_empty.wait(lock, [this] {return !m_queue.empty() || m_closing;});
+			if (m_queue.empty())
+				break;
+			entry = std::move(m_queue.front());
+			m_queue.pop_front();
+			m_queued_bytes -= entry.data.size();
+		}
+		m_not_full.notify_all();
+		// after a failure the queue is still drained so add() does not block
+		if (!m_failed && !write_entry(entry)) {
+			m_error = errno;
+			m_failed = true;
+		}
+	}
+}
+
+bool ArchiveWriter::write_entry(const Entry& entry) {
+	std::vector<char> headers;
+	if (entry.name.size() > NAME_SIZE || std::any_of(entry.name.begin(), entry.name.end(), is_non_ascii)) {
+		const std::string records = pax_record("path", entry.name);
+		headers.resize(BLOCK_SIZE + records.size() + pad_size(records.size(), BLOCK_SIZE) + BLOCK_SIZE);
+		make_header(&headers[0], ascii_name("PaxHeaders/" + entry.name, NAME_SIZE), records.size(), 'x');
+		std::copy(records.begin(), records.end(), &headers[BLOCK_SIZE]);
+		make_header(&headers[headers.size() - BLOCK_SIZE], ascii_name(entry.name, NAME_SIZE), entry.data.size(), '0');
+	}
+	else {
+		headers.resize(BLOCK_SIZE);
+		make_header(&headers[0], entry.name, entry.data.size(), '0');
+	}
+
+	std::vector<iovec> iov { { &headers[0], headers.size() }, { const_cast<char*>(entry.data.data()), entry.data.size() },
+								{ const_cast<char*>(s_zeros), pad_size(entry.data.size(), BLOCK_SIZE) } };
+	return File::write_all(m_fd, iov);
+}
+
+void ArchiveWriter::make_header(char* block, const std::string& name, uint64_t size, char type) const {
+	::memset(block, 0, BLOCK_SIZE);
+	::memcpy(block, name.data(), std::min(name.size(), NAME_SIZE));
+	::snprintf(block + 100, 8, "%07o", 0644);
+	::snprintf(block + 108, 8, "%07o", 0);
+	::snprintf(block + 116, 8, "%07o", 0);
+	::snprintf(block + 124, 12, "%011llo", static_cast<unsigned long long>(size));
+	::snprintf(block + 136, 12, "%011llo", static_cast<unsigned long long>(m_mtime));
+	block[156] = type;
+	::memcpy(block + 257, "ustar", 6);
+	::memcpy(block + 263, "00", 2);
+
+	// the checksum is computed with its own field as spaces
+	::memset(block + 148, ' ', 8);
+	unsigned checksum = 0;
+	for (size_t i = 0; i < BLOCK_SIZE; i++) {
+		checksum += static_cast<unsigned char>(block[i]);
+	}
+	::snprintf(block + 148, 8, "%06o", checksum);
+	block[155] = ' ';
+}
+
+} /* namespace FMF */
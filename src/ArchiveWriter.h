@@ -0,0 +1,111 @@
+/*
+ * ArchiveWriter.h
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#ifndef ARCHIVEWRITER_H_
+#define ARCHIVEWRITER_H_
+
+#include "MusicFileSink.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace FMF {
+
+/**
+ * streams files into a tar archive, set by option --archive.
+ *
+ * the files are queued by the creating threads and written by a single writer thread, so the archive is
+ * written sequentially while the other threads tag the next files. the queue is bounded by MAX_QUEUED_BYTES,
+ * add() blocks while it is full.
+ *
+ * entries are ustar regular files, names longer than 100 bytes or not ascii are preceded by a pax extended
+ * header with the utf-8 path.
+ */
+class ArchiveWriter: public MusicFileSink {
+public:
+	/// archive path for writing to stdout
+	static const char* const STDOUT_PATH;
+
+	ArchiveWriter(const std::string& path);
+	~ArchiveWriter();
+
+	/**
+	 * open the archive and start the writer thread
+	 */
+	bool open();
+
+	/**
+	 * queue the file @e name with content @e data
+	 *
+	 * @return false if writing the archive failed
+	 */
+	virtual bool add(const std::string& name, std::string&& data);
+
+	/**
+	 * write the end of the archive after the queued files and close it
+	 *
+	 * @return false if writing the archive failed
+	 */
+	virtual bool close();
+
+	const std::string& path() const {
+		return m_path;
+	}
+
+private:
+	struct Entry {
+		std::string name;
+		std::string data;
+	};
+
+	void write_entries();
+
+	bool write_entry(const Entry& entry);
+
+	void make_header(char* block, const std::string& name, uint64_t size, char type) const;
+
+	static const size_t BLOCK_SIZE = 512;
+	static const size_t NAME_SIZE = 100;
+	static const size_t MAX_QUEUED_BYTES = 64 << 20;
+
+	const std::string m_path;
+	int m_fd;
+	time_t m_mtime;
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_not_empty;
+	std::condition_variable m_not_full;
+	std::deque<Entry> m_queue;
+	size_t m_queued_bytes;
+	bool m_closing;
+	std::atomic<bool> m_failed;
+	int m_error;
+};
+
+} /* namespace FMF */
+#endif /* ARCHIVEWRITER_H_ */
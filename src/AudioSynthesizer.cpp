@@ -0,0 +1,233 @@
+/*
+ * AudioSynthesizer.cpp
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#include "AudioSynthesizer.h"
+#include "File.h"
+
+#include <errno.h>
+#include <algorithm>
+
+namespace FMF {
+
+/// size of the padding of the empty tag at the start of a stream
+static const size_t TAG_PADDING = 4096;
+
+/// mpeg-1 layer III, no crc, 128kbps, 48kHz, mono: 144 * 128000 / 48000 bytes, 1152 samples (24ms)
+static const uint8_t MP3_HEADER[] = { 0xFF, 0xFB, 0x94, 0xC0 };
+static const size_t MP3_FRAME_SIZE = 384;
+static const size_t MP3_FRAME_MS = 24;
+/// the xing header follows the 17 bytes side info of a mono frame
+static const size_t MP3_XING_OFFSET = sizeof(MP3_HEADER) + 17;
+
+static const uint32_t FLAC_SAMPLE_RATE = 44100;
+static const size_t FLAC_BLOCK_SIZE = 4096;
+/// fixed block size, block size 4096, 44.1kHz, mono, 16 bit
+static const uint8_t FLAC_FRAME_HEADER[] = { 0xFF, 0xF8, 0xC9, 0x08 };
+/// verbatim subframe without wasted bits
+static const uint8_t FLAC_VERBATIM_SUBFRAME = 0x02;
+/// a frame header with the longest frame number and its crc, after the crc of the previous frame
+static const size_t FLAC_FRAME_SLOT = 16;
+
+static uint8_t crc8(const uint8_t* data, size_t len) {
+	uint8_t crc = 0;
+	for (size_t i = 0; i < len; i++) {
+		crc ^= data[i];
+		for (int b = 0; b < 8; b++) {
+			crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+static uint16_t crc16(uint16_t crc, const uint8_t* data, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		crc ^= data[i] << 8;
+		for (int b = 0; b < 8; b++) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+static void put_be(uint8_t* out, uint64_t value, size_t len) {
+	for (size_t i = len; i > 0; i--) {
+		out[i - 1] = value & 0xFF;
+		value >>= 8;
+	}
+}
+
+/**
+ * @return number of bytes of the flac frame number @e n coded by put_utf8()
+ */
+static size_t utf8_len(uint32_t n) {
+	return n < 0x80 ? 1 : n < 0x800 ? 2 : n < 0x10000 ? 3 : n < 0x200000 ? 4 : n < 0x4000000 ? 5 : 6;
+}
+
+/**
+ * flac frame number, coded as utf-8 extended to 31 bits
+ *
+ * @return number of bytes written to @e out, at most 6
+ */
+static size_t put_utf8(uint8_t* out, uint32_t n) {
+	if (n < 0x80) {
+		out[0] = n;
+		return 1;
+	}
+	const size_t len = utf8_len(n);
+	for (size_t i = len - 1; i > 0; i--) {
+		out[i] = 0x80 | (n & 0x3F);
+		n >>= 6;
+	}
+	out[0] = (0xFF00 >> len) | n;
+	return len;
+}
+
+static size_t mp3_num_frames(size_t duration_ms) {
+	return std::max<size_t>(1, duration_ms / MP3_FRAME_MS);
+}
+
+static size_t flac_num_frames(size_t duration_ms) {
+	const uint64_t num_samples = static_cast<uint64_t>(duration_ms) * FLAC_SAMPLE_RATE / 1000;
+	return std::max<size_t>(1, (num_samples + FLAC_BLOCK_SIZE - 1) / FLAC_BLOCK_SIZE);
+}
+
+static iovec make_iovec(const void* data, size_t len) {
+	iovec iov;
+	iov.iov_base = const_cast<void*>(data);
+	iov.iov_len = len;
+	return iov;
+}
+
+AudioSynthesizer::AudioSynthesizer() :
+		m_mp3_frame(MP3_FRAME_SIZE), m_flac_body(1 + FLAC_BLOCK_SIZE * 2), m_flac_body_crc(0), m_flac_crc_bits(), m_padding(
+				TAG_PADDING) {
+	// zero side info and main data decode as silence
+	std::copy(MP3_HEADER, MP3_HEADER + sizeof(MP3_HEADER), m_mp3_frame.begin());
+
+	m_flac_body[0] = FLAC_VERBATIM_SUBFRAME;
+	m_flac_body_crc = crc16(0, &m_flac_body[0], m_flac_body.size());
+	for (size_t b = 0; b < 16; b++) {
+		m_flac_crc_bits[b] = crc16(1 << b, &m_flac_body[0], m_flac_body.size()) ^ m_flac_body_crc;
+	}
+}
+
+AudioSynthesizer::~AudioSynthesizer() {
+}
+
+bool AudioSynthesizer::write_mp3(int fd, size_t duration_ms) const {
+	const size_t num_frames = mp3_num_frames(duration_ms);
+
+	// id3v2.3 tag of padding only, the size is syncsafe
+	uint8_t id3[10] = { 'I', 'D', '3', 3, 0, 0 };
+	for (size_t i = 0; i < 4; i++) {
+		id3[9 - i] = (TAG_PADDING >> (7 * i)) & 0x7F;
+	}
+
+	// silent frame with an Info header (the xing header of cbr streams) of frames and bytes
+	std::vector<uint8_t> info(m_mp3_frame);
+	uint8_t* xing = &info[MP3_XING_OFFSET];
+	std::copy_n("Info", 4, xing);
+	put_be(xing + 4, 0x3, 4);
+	put_be(xing + 8, num_frames, 4);
+	put_be(xing + 12, (num_frames + 1) * MP3_FRAME_SIZE, 4);
+
+	std::vector<iovec> iov;
+	iov.reserve(num_frames + 3);
+	iov.push_back(make_iovec(id3, sizeof(id3)));
+	iov.push_back(make_iovec(&m_padding[0], m_padding.size()));
+	iov.push_back(make_iovec(&info[0], info.size()));
+	for (size_t i = 0; i < num_frames; i++) {
+		iov.push_back(make_iovec(&m_mp3_frame[0], m_mp3_frame.size()));
+	}
+	return File::write_all(fd, iov);
+}
+
+bool AudioSynthesizer::write_flac(int fd, size_t duration_ms) const {
+	const size_t num_frames = flac_num_frames(duration_ms);
+
+	// fLaC, STREAMINFO and the header of the last metadata block, PADDING
+	uint8_t head[4 + 4 + 34 + 4] = { 'f', 'L', 'a', 'C', 0x00, 0, 0, 34 };
+	uint8_t* info = head + 8;
+	put_be(info, FLAC_BLOCK_SIZE, 2);
+	put_be(info + 2, FLAC_BLOCK_SIZE, 2);
+	// frame sizes (unknown: 0), then sample rate:20 channels-1:3 bits per sample-1:5 samples:36, then md5 (unknown: 0)
+	put_be(info + 10, (uint64_t(FLAC_SAMPLE_RATE) << 44) | (uint64_t(16 - 1) << 36) | (num_frames * FLAC_BLOCK_SIZE), 8);
+	uint8_t* padding = info + 34;
+	padding[0] = 0x80 | 1;
+	put_be(padding + 1, TAG_PADDING, 3);
+
+	std::vector<uint8_t> slots(num_frames * FLAC_FRAME_SLOT + 2);
+	std::vector<iovec> iov;
+	iov.reserve(2 * num_frames + 3);
+	iov.push_back(make_iovec(head, sizeof(head)));
+	iov.push_back(make_iovec(&m_padding[0], m_padding.size()));
+	uint16_t frame_crc = 0;
+	for (size_t i = 0; i < num_frames; i++) {
+		uint8_t* slot = &slots[i * FLAC_FRAME_SLOT];
+		size_t len = 0;
+		if (i) {
+			put_be(slot, frame_crc, 2);
+			len = 2;
+		}
+		uint8_t* header = slot + len;
+		std::copy(FLAC_FRAME_HEADER, FLAC_FRAME_HEADER + sizeof(FLAC_FRAME_HEADER), header);
+		size_t header_len = sizeof(FLAC_FRAME_HEADER);
+		header_len += put_utf8(header + header_len, i);
+		header[header_len] = crc8(header, header_len);
+		header_len++;
+		frame_crc = flac_frame_crc(crc16(0, header, header_len));
+
+		iov.push_back(make_iovec(slot, len + header_len));
+		iov.push_back(make_iovec(&m_flac_body[0], m_flac_body.size()));
+	}
+	uint8_t* last = &slots[num_frames * FLAC_FRAME_SLOT];
+	put_be(last, frame_crc, 2);
+	iov.push_back(make_iovec(last, 2));
+	return File::write_all(fd, iov);
+}
+
+/*static*/size_t AudioSynthesizer::mp3_size(size_t duration_ms) {
+	// id3v2 header and padding, the Info frame and the silent frames
+	return 10 + TAG_PADDING + (mp3_num_frames(duration_ms) + 1) * MP3_FRAME_SIZE;
+}
+
+/*static*/size_t AudioSynthesizer::flac_size(size_t duration_ms) {
+	const size_t num_frames = flac_num_frames(duration_ms);
+	// fLaC, STREAMINFO, PADDING, then the frames: header, frame number, crc-8, body, crc-16
+	size_t size = 4 + 4 + 34 + 4 + TAG_PADDING;
+	size += num_frames * (sizeof(FLAC_FRAME_HEADER) + 1 + 1 + FLAC_BLOCK_SIZE * 2 + 2);
+	for (size_t i = 0; i < num_frames; i++) {
+		size += utf8_len(i);
+	}
+	return size;
+}
+
+uint16_t AudioSynthesizer::flac_frame_crc(uint16_t header_crc) const {
+	uint16_t crc = m_flac_body_crc;
+	for (size_t b = 0; header_crc; b++, header_crc >>= 1) {
+		if (header_crc & 1) {
+			crc ^= m_flac_crc_bits[b];
+		}
+	}
+	return crc;
+}
+
+} /* namespace FMF */
@@ -0,0 +1,89 @@
+/*
+ * AudioSynthesizer.h
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#ifndef AUDIOSYNTHESIZER_H_
+#define AUDIOSYNTHESIZER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace FMF {
+
+/**
+ * writes valid silent mp3 and flac streams of a given duration.
+ *
+ * the audio frames are written with writev from buffers built once and shared by all threads,
+ * so the cost of a file is mostly the write of its size. the stream starts with an empty tag
+ * with padding, so tagging the file does not rewrite it.
+ *
+ * mp3: id3v2 padding, an Info (xing) frame with the number of frames, then 128kbps 48kHz mono
+ * cbr silent frames.
+ * flac: STREAMINFO with the number of samples, PADDING, then 44.1kHz 16 bit mono frames of 4096
+ * zero samples in verbatim subframes. only the frame number and the crcs differ between frames.
+ */
+class AudioSynthesizer {
+public:
+	AudioSynthesizer();
+	~AudioSynthesizer();
+
+	/**
+	 * write a silent mp3 stream of @e duration_ms to @e fd
+	 *
+	 * @return false if writing failed, errno is set
+	 */
+	bool write_mp3(int fd, size_t duration_ms) const;
+
+	/**
+	 * write a silent flac stream of @e duration_ms to @e fd
+	 *
+	 * @return false if writing failed, errno is set
+	 */
+	bool write_flac(int fd, size_t duration_ms) const;
+
+	/**
+	 * @return size of the mp3 stream of @e duration_ms written by write_mp3()
+	 */
+	static size_t mp3_size(size_t duration_ms);
+
+	/**
+	 * @return size of the flac stream of @e duration_ms written by write_flac()
+	 */
+	static size_t flac_size(size_t duration_ms);
+
+private:
+	/**
+	 * @return crc-16 of the flac frame, from the crc of its header @e header_crc and the shared frame body
+	 */
+	uint16_t flac_frame_crc(uint16_t header_crc) const;
+
+	std::vector<uint8_t> m_mp3_frame;
+	std::vector<uint8_t> m_flac_body;
+	/// crc of the flac body started from 0
+	uint16_t m_flac_body_crc;
+	/// change of the crc of the flac body by each bit of the start crc, crc-16 is linear
+	uint16_t m_flac_crc_bits[16];
+	/// zeros of the tag padding
+	std::vector<uint8_t> m_padding;
+};
+
+} /* namespace FMF */
+#endif /* AUDIOSYNTHESIZER_H_ */
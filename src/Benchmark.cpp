@@ -0,0 +1,291 @@
+/*
+ * Benchmark.cpp
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#include "Benchmark.h"
+#include "config.h"
+#include "Context.h"
+#include "Dir.h"
+#include "Launcher.h"
+#include "Manifest.h"
+#include "MusicFilesGenerator.h"
+#include "Options.h"
+#include "Tracer.h"
+
+#include <ftw.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace FMF {
+
+static const size_t NUM_STAGES = static_cast<size_t>(Context::Stage::NUM_STAGES);
+
+static double seconds(const struct timeval& tv) {
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int remove_entry(const char* path, const struct stat*, int, struct FTW*) {
+	return ::remove(path);
+}
+
+//-----------------------------------------------------------------------------
+// Benchmark::Params
+//-----------------------------------------------------------------------------
+Benchmark::Params::Params() :
+		threads(), copy_strategies { MusicFileCreator::CopyStrategy::STREAM, MusicFileCreator::CopyStrategy::MEMORY,
+										MusicFileCreator::CopyStrategy::COPY_RANGE }, json_file() {
+	const size_t num_cpus = std::max(1U, std::thread::hardware_concurrency());
+	for (size_t n = 1; n < num_cpus; n *= 2) {
+		threads.push_back(n);
+	}
+	threads.push_back(num_cpus);
+}
+
+bool Benchmark::Params::parse(const std::string& spec) {
+	bool valid = true;
+	std::istringstream is(spec);
+	std::string item;
+	while (std::getline(is, item, ',')) {
+		auto pos = item.find('=');
+		std::string key = item.substr(0, pos);
+		std::string value = (pos == std::string::npos) ? "" : item.substr(pos + 1);
+		bool ok = !value.empty();
+		std::istringstream values(value);
+		std::string val;
+		if (key == "threads") {
+			threads.clear();
+			while (ok && std::getline(values, val, '/')) {
+				unsigned long n;
+				int end = 0;
+				ok = 1 == ::sscanf(val.c_str(), "%lu%n", &n, &end) && end == (int) val.size() && n > 0 && n <= 4096;
+				threads.push_back(n);
+			}
+		}
+		else if (key == "copy") {
+			copy_strategies.clear();
+			while (ok && std::getline(values, val, '/')) {
+				MusicFileCreator::CopyStrategy strategy;
+				ok = MusicFileCreator::parse_copy_strategy(val, strategy);
+				copy_strategies.push_back(strategy);
+			}
+		}
+		else if (key == "json") {
+			json_file = value;
+		}
+		else {
+			ok = false;
+		}
+		if (!ok) {
+			Tracer::cerr("--benchmark invalid parameter \"", item, "\"");
+			valid = false;
+		}
+	}
+	return valid;
+}
+
+std::ostream& operator<<(std::ostream& os, const Benchmark::Params& params) {
+	os << "threads=";
+	for (size_t i = 0; i < params.threads.size(); i++) {
+		os << (i ? "/" : "") << params.threads[i];
+	}
+	os << ",copy=";
+	for (size_t i = 0; i < params.copy_strategies.size(); i++) {
+		os << (i ? "/" : "") << MusicFileCreator::copy_strategy_name(params.copy_strategies[i]);
+	}
+	if (!params.json_file.empty()) {
+		os << ",json=" << params.json_file;
+	}
+	return os;
+}
+
+//-----------------------------------------------------------------------------
+// Benchmark
+//-----------------------------------------------------------------------------
+Benchmark::Benchmark(const Options& opts) :
+		m_opts(opts), m_results() {
+}
+
+Benchmark::~Benchmark() {
+}
+
+bool Benchmark::run() {
+	const Params& params = m_opts.benchmark_params();
+	const size_t num_runs = params.threads.size() * params.copy_strategies.size();
+	for (size_t threads : params.threads) {
+		for (auto copy_strategy : params.copy_strategies) {
+			if (Context::stopped())
+				break;
+			Tracer::cout("Run ", m_results.size() + 1, "/", num_runs, ": threads=", threads, " copy=",
+					MusicFileCreator::copy_strategy_name(copy_strategy));
+			Result result;
+			if (!run_once(threads, copy_strategy, result))
+				return false;
+			m_results.push_back(result);
+		}
+	}
+
+	output_table(std::cout);
+	if (params.json_file.empty()) {
+		output_json(std::cout);
+		return true;
+	}
+	std::ofstream os(params.json_file);
+	output_json(os);
+	os.close();
+	if (os.fail()) {
+		Tracer::cerr("failed to write the benchmark report to ", params.json_file);
+		return false;
+	}
+	Tracer::cout("Wrote the benchmark report to ", params.json_file);
+	return true;
+}
+
+bool Benchmark::run_once(size_t num_threads, MusicFileCreator::CopyStrategy copy_strategy, Result& result) {
+	Options opts(m_opts);
+	if (!opts.set_num_threads(num_threads) || !opts.set_copy_strategy(copy_strategy)) {
+		Tracer::cerr("benchmark run threads=", num_threads, " copy=", MusicFileCreator::copy_strategy_name(copy_strategy),
+				" is not supported with the options set");
+		return false;
+	}
+	// the cddb cache is updated once, by the first run
+	opts.set_update_cache(m_opts.update_cache() && m_results.empty());
+
+	// a dry run writes no files, it runs without a benchmark directory
+	const bool dry_run = m_opts.dry_run() != MusicFileCreator::DryRun::NONE;
+	std::ostringstream dir_name;
+	dir_name << "fmf-benchmark." << ::getpid() << '.' << m_results.size() + 1;
+	Dir out_dir = Dir(m_opts.output_dir()).sub_dir(dir_name.str());
+	if (!dry_run && (!out_dir.create() || !opts.set_output_dir(out_dir.path()))) {
+		Tracer::cerr("failed to create benchmark directory ", out_dir.path());
+		return false;
+	}
+
+	bool res = false;
+	{
+		Context ctx(opts);
+		MusicFileCreator creator(ctx);
+		MusicFilesGenerator generator(ctx);
+		if (ctx.init() && creator.init()) {
+			struct rusage usage_start, usage_end;
+			::getrusage(RUSAGE_SELF, &usage_start);
+			auto start = std::chrono::steady_clock::now();
+
+			if (num_threads > 1 || m_opts.placement().is_set()) {
+				Launcher launcher(m_opts.placement());
+				launcher.launch(num_threads, generator, creator);
+			}
+			else {
+				generator(creator);
+			}
+			// the bad cddb files are not marked, so every run picks the same files
+			creator.finish();
+
+			auto elapsed = std::chrono::steady_clock::now() - start;
+			::getrusage(RUSAGE_SELF, &usage_end);
+
+			result.threads = num_threads;
+			result.copy_strategy = copy_strategy;
+			result.created = ctx.create_success_count();
+			result.skipped = ctx.create_skipped_count();
+			result.failed = ctx.create_failed_count() + ctx.parse_fail_count();
+			result.bytes = ctx.bytes_written();
+			result.seconds = std::chrono::duration<double>(elapsed).count();
+			result.cpu_seconds = seconds(usage_end.ru_utime) - seconds(usage_start.ru_utime)
+					+ seconds(usage_end.ru_stime) - seconds(usage_start.ru_stime);
+			for (size_t stage = 0; stage < NUM_STAGES; stage++) {
+				auto time = ctx.stage_time(static_cast<Context::Stage>(stage));
+				result.stage_seconds.push_back(std::chrono::duration<double>(time).count());
+			}
+			res = true;
+		}
+	}
+
+	if (!dry_run && ::nftw(out_dir.path().c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS)) {
+		Tracer::_warn("failed to remove benchmark directory ", out_dir.path());
+	}
+	return res;
+}
+
+void Benchmark::output_table(std::ostream& os) const {
+	char line[256];
+	int len = ::snprintf(line, sizeof(line), "%7s %-10s %8s %9s %8s %6s", "threads", "copy", "files", "files/s",
+			"MB/s", "cpu%");
+	for (size_t stage = 0; stage < NUM_STAGES; stage++) {
+		len += ::snprintf(line + len, sizeof(line) - len, " %7s", Context::stage_name(static_cast<Context::Stage>(stage)));
+	}
+	os << std::string(len, '-') << std::endl;
+	os << "Benchmark: " << m_opts.num_albums() << " albums, seed " << m_opts.seed();
+	if (m_opts.dry_run() != MusicFileCreator::DryRun::NONE) {
+		os << ", dry run --dry-run=" << MusicFileCreator::dry_run_name(m_opts.dry_run());
+	}
+	os << ", stage times in us per file" << std::endl;
+	os << std::string(len, '-') << std::endl;
+	os << line << std::endl;
+
+	for (auto& r : m_results) {
+		const double secs = r.seconds > 0 ? r.seconds : 1e-9;
+		const size_t files = r.created ? r.created : 1;
+		len = ::snprintf(line, sizeof(line), "%7zu %-10s %8zu %9.1f %8.2f %6.1f", r.threads,
+				MusicFileCreator::copy_strategy_name(r.copy_strategy), r.created, r.created / secs, r.bytes / 1e6 / secs,
+				100 * r.cpu_seconds / secs);
+		for (double stage_secs : r.stage_seconds) {
+			len += ::snprintf(line + len, sizeof(line) - len, " %7.1f", stage_secs * 1e6 / files);
+		}
+		os << line << std::endl;
+	}
+	os << std::string(len, '-') << std::endl;
+}
+
+void Benchmark::output_json(std::ostream& os) const {
+	os << "{\"fmf\":\"" << PACKAGE_VERSION << "\",\"albums\":" << m_opts.num_albums() << ",\"seed\":" << m_opts.seed()
+			<< ",\"dry_run\":\"" << MusicFileCreator::dry_run_name(m_opts.dry_run()) << "\",\"templates\":[";
+	for (size_t i = 0; i < m_opts.template_music_files().size(); i++) {
+		os << (i ? "," : "") << Manifest::json_string(m_opts.template_music_files()[i]);
+	}
+	os << "],\"runs\":[";
+	char buf[512];
+	for (size_t i = 0; i < m_results.size(); i++) {
+		const Result& r = m_results[i];
+		const double secs = r.seconds > 0 ? r.seconds : 1e-9;
+		const size_t files = r.created ? r.created : 1;
+		::snprintf(buf, sizeof(buf), "%s{\"threads\":%zu,\"copy\":\"%s\",\"files\":%zu,\"skipped\":%zu,\"failed\":%zu,"
+				"\"bytes\":%llu,\"seconds\":%.6f,\"files_per_sec\":%.1f,\"mb_per_sec\":%.3f,\"cpu_percent\":%.1f,"
+				"\"stage_us_per_file\":{", i ? "," : "", r.threads, MusicFileCreator::copy_strategy_name(r.copy_strategy),
+				r.created, r.skipped, r.failed, static_cast<unsigned long long>(r.bytes), r.seconds, r.created / secs,
+				r.bytes / 1e6 / secs, 100 * r.cpu_seconds / secs);
+		os << buf;
+		for (size_t stage = 0; stage < NUM_STAGES; stage++) {
+			::snprintf(buf, sizeof(buf), "%s\"%s\":%.2f", stage ? "," : "",
+					Context::stage_name(static_cast<Context::Stage>(stage)), r.stage_seconds[stage] * 1e6 / files);
+			os << buf;
+		}
+		os << "}}";
+	}
+	os << "]}" << std::endl;
+}
+
+} /* namespace FMF */
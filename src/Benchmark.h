@@ -0,0 +1,101 @@
+/*
+ * Benchmark.h
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include "MusicFileCreator.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace FMF {
+
+class Options;
+
+/**
+ * runs the same seeded workload through MusicFilesGenerator and MusicFileCreator for each number of threads
+ * and copy strategy, and reports the throughput and the time of each Context::Stage.
+ *
+ * each run writes to its own sub dir of the output dir, which is removed after the run.
+ */
+class Benchmark {
+public:
+	/**
+	 * benchmark parameters, set by option --benchmark=<key>=<value>,...
+	 */
+	struct Params {
+		Params();
+
+		/**
+		 * parse a comma separated list of key=value
+		 *
+		 * @return false if @e spec is invalid
+		 */
+		bool parse(const std::string& spec);
+
+		std::vector<size_t> threads;
+		std::vector<MusicFileCreator::CopyStrategy> copy_strategies;
+		/// file the json report is written to, if empty it is output after the table
+		std::string json_file;
+	};
+
+	Benchmark(const Options& opts);
+	~Benchmark();
+
+	/**
+	 * run all the combinations of threads and copy strategies and output the report
+	 *
+	 * @return false if a run failed to start or the json report could not be written
+	 */
+	bool run();
+
+	friend std::ostream& operator<<(std::ostream& os, const Params& params);
+
+private:
+	struct Result {
+		size_t threads;
+		MusicFileCreator::CopyStrategy copy_strategy;
+		size_t created;
+		size_t skipped;
+		size_t failed;
+		uint64_t bytes;
+		double seconds;
+		double cpu_seconds;
+		/// time of each Context::Stage summed over all threads
+		std::vector<double> stage_seconds;
+	};
+
+	bool run_once(size_t num_threads, MusicFileCreator::CopyStrategy copy_strategy, Result& result);
+
+	void output_table(std::ostream& os) const;
+
+	void output_json(std::ostream& os) const;
+
+	const Options& m_opts;
+	std::vector<Result> m_results;
+};
+
+} /* namespace FMF */
+#endif /* BENCHMARK_H_ */
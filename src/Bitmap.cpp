@@ -0,0 +1,76 @@
+/*
+ * Bitmap.cpp
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#include "Bitmap.h"
+
+#include <istream>
+#include <ostream>
+
+namespace FMF {
+
+Bitmap::Bitmap() :
+		m_words(), m_size(0), m_count(0) {
+}
+
+void Bitmap::reset(size_t size) {
+	m_words.assign((size + 63) / 64, 0);
+	m_size = size;
+	m_count = 0;
+}
+
+void Bitmap::set(size_t index) {
+	uint64_t& word = m_words[index / 64];
+	const uint64_t bit = uint64_t(1) << (index % 64);
+	if (!(word & bit)) {
+		word |= bit;
+		m_count++;
+	}
+}
+
+void Bitmap::merge(const Bitmap& other) {
+	m_count = 0;
+	for (size_t i = 0; i < m_words.size(); i++) {
+		m_words[i] |= other.m_words[i];
+		m_count += __builtin_popcountll(m_words[i]);
+	}
+}
+
+bool Bitmap::read(std::istream& is, size_t size) {
+	uint32_t bits;
+	if (!is.read(reinterpret_cast<char*>(&bits), sizeof(bits)) || bits != size)
+		return false;
+	reset(size);
+	is.read(reinterpret_cast<char*>(m_words.data()), m_words.size() * sizeof(uint64_t));
+	if (!is)
+		return false;
+	for (uint64_t word : m_words) {
+		m_count += __builtin_popcountll(word);
+	}
+	return true;
+}
+
+void Bitmap::write(std::ostream& os) const {
+	const uint32_t bits = m_size;
+	os.write(reinterpret_cast<const char*>(&bits), sizeof(bits));
+	os.write(reinterpret_cast<const char*>(m_words.data()), m_words.size() * sizeof(uint64_t));
+}
+
+} /* namespace FMF */
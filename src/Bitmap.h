@@ -0,0 +1,82 @@
+/*
+ * Bitmap.h
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#ifndef BITMAP_H_
+#define BITMAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <iosfwd>
+#include <vector>
+
+namespace FMF {
+
+/**
+ * a bit for each index [0, size()), e.g. the entries of a DiscIdList that are not picked
+ */
+class Bitmap {
+public:
+	Bitmap();
+
+	/**
+	 * clear all the bits and resize to @e size bits
+	 */
+	void reset(size_t size);
+
+	size_t size() const {
+		return m_size;
+	}
+
+	bool test(size_t index) const {
+		return (m_words[index / 64] >> (index % 64)) & 1;
+	}
+
+	void set(size_t index);
+
+	/**
+	 * set the bits set in @e other, of the same size()
+	 */
+	void merge(const Bitmap& other);
+
+	/**
+	 * @return number of set bits
+	 */
+	size_t count() const {
+		return m_count;
+	}
+
+	/**
+	 * read the bitmap written by write()
+	 *
+	 * @return false if the data is not a bitmap of @e size bits
+	 */
+	bool read(std::istream& is, size_t size);
+
+	void write(std::ostream& os) const;
+
+private:
+	std::vector<uint64_t> m_words;
+	size_t m_size;
+	size_t m_count;
+};
+
+} /* namespace FMF */
+#endif /* BITMAP_H_ */
@@ -22,12 +22,19 @@
 #include "CDDB.h"
 #include "Dir.h"
 #include "File.h"
+#include "Launcher.h"
 #include "Tracer.h"
 #include "Context.h"
 
 #include <dirent.h>
+#include <errno.h>
 #include <error.h>
+#include <fcntl.h>
 #include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <cstdlib>
 #include <fstream>
@@ -35,9 +42,32 @@
 #include <iostream>
 #include <iterator>
 #include <numeric>
+#include <stdexcept>
+#include <thread>
 
 namespace FMF {
 
+/// number of files read by a thread at a time by index_albums()
+static const size_t INDEX_CHUNK_SIZE = 256;
+
+/**
+ * lock the bad files at @e path against the fmf processes sharing the cache, which mark bad files at the same time
+ *
+ * @return the fd of the lock file, closing it releases the lock, or -1 if locking failed
+ */
+static int lock_bad_files(const std::string& path) {
+	const std::string lock_path = path + ".lock";
+	int fd = ::open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd >= 0 && ::flock(fd, LOCK_EX)) {
+		::close(fd);
+		fd = -1;
+	}
+	if (fd < 0) {
+		Tracer::_warn("failed to lock the bad cddb files: ", lock_path, ": ", ::strerror(errno));
+	}
+	return fd;
+}
+
 /**
  * thrown when cached cddb dir is different from option cddb dir
  */
@@ -61,7 +91,8 @@ CDDB::CDDB(const std::string& db_dir) :
 }
 
 CDDB::CDDB(const std::string& db_dir, const std::string& cache_dir, const std::string& cache_file_name) :
-		m_db_dir(db_dir), m_cache_dir(cache_dir), m_cache_file_name(cache_file_name), m_db_cache(*this), m_prng() {
+		m_db_dir(db_dir), m_cache_dir(cache_dir), m_cache_file_name(cache_file_name), m_genre_weights(), m_dedup_albums(
+				false), m_album_filter(), m_db_cache(*this), m_prng() {
 	auto seed = std::random_device()();
 	Tracer::_debug("seeding rng with: ", seed);
 	m_prng.seed(seed);
@@ -76,15 +107,50 @@ std::string CDDB::cddb_cache_file() {
 
 bool CDDB::init(bool update_cache) {
 	bool res = (!update_cache && DBCache::read(m_db_cache, m_cache_dir, m_cache_file_name))
-			|| DBCache::create(m_db_cache, s_def_cache_dir, s_def_cache_file);
+			|| DBCache::create(m_db_cache, m_cache_dir, m_cache_file_name);
 
+	const bool index = (m_dedup_albums && !m_db_cache.is_deduped())
+			|| (m_album_filter.is_set() && !m_db_cache.is_indexed());
+	if (res && index) {
+		res = m_db_cache.index_albums() && DBCache::write(m_db_cache, m_cache_dir, m_cache_file_name);
+	}
 	if (res && !num_cached_files()) {
 		Tracer::_err("the CDDB cache if empty. db dir is probably not a CDDB database dir.");
 		res = false;
 	}
+	if (res && !m_db_cache.init_random()) {
+		Tracer::_err("genre weights (--genre-weights), album filters and bad cddb files leave no cddb file to pick",
+				" from. (bad cddb files are picked again after the cache is updated with --update)");
+		res = false;
+	}
+	if (res) {
+		Tracer::_info("cddb cache: ", num_cached_files(), " files in ", m_db_cache.bytes(), " bytes");
+		if (m_dedup_albums) {
+			Tracer::_info("cddb cache: skipping ", m_db_cache.num_duplicates(), " duplicate albums");
+		}
+		if (m_db_cache.num_bad()) {
+			Tracer::_info("cddb cache: skipping ", m_db_cache.num_bad(), " bad files");
+		}
+		if (m_album_filter.is_set()) {
+			Tracer::_info("cddb cache: ", m_db_cache.num_picks(), " files match the album filter:", m_album_filter);
+		}
+	}
 	return res;
 }
 
+size_t CDDB::mark_bad_files(const std::vector<std::string>& paths) {
+	const size_t marked = m_db_cache.mark_bad_files(paths);
+	if (marked) {
+		Tracer::cout("Marked ", marked, " cddb files that failed parsing as bad in the cddb cache");
+		// the next runs of this process skip them too
+		if (!m_db_cache.init_random()) {
+			Tracer::_warn("all the cddb files to pick from are bad, picking them again until the process exits");
+			m_db_cache.init_random(false);
+		}
+	}
+	return marked;
+}
+
 std::string CDDB::random_file() const {
 	return m_db_cache.random_file(m_prng);
 }
@@ -97,13 +163,12 @@ size_t CDDB::num_cached_files() const {
 // CDDB::DBCache
 //-----------------------------------------------------------------------------
 CDDB::DBCache::DBCache(const CDDB& cddb) :
-		m_cddb(cddb), m_genres(), m_random_dist() {
+		m_cddb(cddb), m_genres(), m_genre_table() {
 }
 
 /*static*/bool CDDB::DBCache::create(CDDB::DBCache& cache, const std::string& cache_dir,
 		const std::string& cache_file_name) {
 	bool success = true;
-	const std::string cache_file = cache_dir + Dir::DIR_SEP + cache_file_name;
 	Dir dir(cache_dir);
 	if (!dir.create()) {
 		Tracer::_err("failed to create cache dir: ", cache_dir);
@@ -115,16 +180,10 @@ CDDB::DBCache::DBCache(const CDDB& cddb) :
 			Tracer::_err("scanning produced no valid cddb files from dir: ", cache.db_dir());
 			return false;
 		}
-		std::ofstream os(cache_file);
-		Tracer::cout("writing cddb cache file: ", cache_file);
-		try {
-			os << cache;
-			cache.init_random();
-		}
-		catch (std::exception& e) {
-			success = false;
-			Tracer::_err("writing cache failed: ", cache_file, " ", e.what());
+		if (cache.m_cddb.dedup_albums() || cache.m_cddb.album_filter().is_set()) {
+			success = cache.index_albums();
 		}
+		success = success && write(cache, cache_dir, cache_file_name);
 	}
 	else {
 		if (Context::stopped()) {
@@ -148,7 +207,6 @@ CDDB::DBCache::DBCache(const CDDB& cddb) :
 		is.open(cache_file);
 		is >> cache;
 		is.close();
-		cache.init_random();
 	}
 	catch (const InvalidCacheException& e) {
 		success = false;
@@ -163,6 +221,22 @@ CDDB::DBCache::DBCache(const CDDB& cddb) :
 	return success;
 }
 
+/*static*/bool CDDB::DBCache::write(const CDDB::DBCache& cache, const std::string& cache_dir,
+		const std::string& cache_file_name) {
+	bool success = true;
+	const std::string cache_file = cache_dir + Dir::DIR_SEP + cache_file_name;
+	std::ofstream os(cache_file);
+	Tracer::cout("writing cddb cache file: ", cache_file);
+	try {
+		os << cache;
+	}
+	catch (std::exception& e) {
+		success = false;
+		Tracer::_err("writing cache failed: ", cache_file, " ", e.what());
+	}
+	return success;
+}
+
 void CDDB::DBCache::on_dir_begin(const Dir& /*dir*/) {
 }
 
@@ -192,18 +266,188 @@ void CDDB::DBCache::on_dir_end(const Dir& /*dir*/) {
 
 bool CDDB::DBCache::scan() {
 	Dir dir(m_cddb.db_dir());
+	// the genres of a cache that failed reading
+	m_genres.clear();
 	return dir.for_each(*this);
 }
 
-void CDDB::DBCache::init_random() {
-	m_random_dist.param(RandomDistribution::param_type(1, m_genres.size()));
+bool CDDB::DBCache::index_albums() {
+	// index of the first file of each genre in the files of all genres
+	std::vector<size_t> first_file;
+	size_t num_files = 0;
 	for (auto& gc : m_genres) {
-		gc.init_random();
+		first_file.push_back(num_files);
+		num_files += gc.size();
+	}
+	auto genre_of = [&first_file](size_t file) {
+		return std::upper_bound(first_file.begin(), first_file.end(), file) - first_file.begin() - 1;
+	};
+
+	Tracer::cout("indexing albums of ", num_files, " cddb files");
+	std::vector<AlbumIndex::Album> albums(num_files);
+	std::atomic<size_t> next_chunk(0);
+	std::atomic<size_t> failed(0);
+	auto read_albums = [&]() {
+		size_t begin;
+		while (!Context::stopped() && (begin = INDEX_CHUNK_SIZE * next_chunk++) < num_files) {
+			const size_t end = std::min(begin + INDEX_CHUNK_SIZE, num_files);
+			for (size_t file = begin; file < end; file++) {
+				const size_t genre = genre_of(file);
+				if (!AlbumIndex::read_album(m_genres[genre].file_path(file - first_file[genre]), albums[file])) {
+					failed++;
+				}
+			}
+		}
+	};
+	const size_t num_threads = std::max(1U, std::thread::hardware_concurrency());
+	if (num_threads > 1) {
+		Launcher launcher;
+		launcher.launch(num_threads, read_albums);
+	}
+	else {
+		read_albums();
+	}
+	if (Context::stopped()) {
+		Tracer::cout("indexing albums interrupted: ", db_dir());
+		return false;
+	}
+	if (failed) {
+		Tracer::_warn("failed to read ", failed, " cddb files, indexed as albums of unknown metadata");
+	}
+
+	for (auto& gc : m_genres) {
+		gc.reset_albums();
+		gc.reset_duplicates();
+	}
+	// the first file of each album is kept, the files with the same key after it are marked
+	std::vector<std::pair<uint64_t, size_t>> keys;
+	keys.reserve(num_files);
+	for (size_t file = 0; file < num_files; file++) {
+		const size_t genre = genre_of(file);
+		m_genres[genre].set_album(file - first_file[genre], albums[file]);
+		if (albums[file].key) {
+			keys.emplace_back(albums[file].key, file);
+		}
+	}
+	albums = std::vector<AlbumIndex::Album>();
+	std::sort(keys.begin(), keys.end());
+	for (size_t i = 1; i < keys.size(); i++) {
+		if (keys[i].first == keys[i - 1].first) {
+			const size_t genre = genre_of(keys[i].second);
+			m_genres[genre].mark_duplicate(keys[i].second - first_file[genre]);
+		}
+	}
+	Tracer::cout("Indexed ", num_files, " cddb files, marked ", num_duplicates(), " duplicate albums");
+	return true;
+}
+
+bool CDDB::DBCache::is_deduped() const {
+	return std::all_of(m_genres.begin(), m_genres.end(), [](const GenreCache& genre) {return genre.is_deduped();});
+}
+
+bool CDDB::DBCache::is_indexed() const {
+	return std::all_of(m_genres.begin(), m_genres.end(), [](const GenreCache& genre) {return genre.is_indexed();});
+}
+
+size_t CDDB::DBCache::num_duplicates() const {
+	return std::accumulate(m_genres.begin(), m_genres.end(), size_t(0),
+			[](size_t sum, const GenreCache& genre) {return sum + genre.num_duplicates();});
+}
+
+size_t CDDB::DBCache::mark_bad_files(const std::vector<std::string>& paths) {
+	const std::string prefix = db_dir() + Dir::DIR_SEP;
+	std::vector<bool> changed(m_genres.size());
+	size_t marked = 0;
+	for (auto& path : paths) {
+		// <db dir>/<genre>/<disc id> from random_file()
+		const auto name_pos = path.find(Dir::DIR_SEP, prefix.size());
+		if (path.compare(0, prefix.size(), prefix) || name_pos == std::string::npos)
+			continue;
+		const std::string genre = path.substr(prefix.size(), name_pos - prefix.size());
+		for (size_t i = 0; i < m_genres.size(); i++) {
+			if (m_genres[i].name() == genre && m_genres[i].mark_bad(path.substr(name_pos + 1))) {
+				changed[i] = true;
+				marked++;
+			}
+		}
+	}
+	for (size_t i = 0; i < m_genres.size(); i++) {
+		if (changed[i]) {
+			merge_bad(m_genres[i]);
+		}
 	}
+	return marked;
+}
+
+void CDDB::DBCache::write_bad(const GenreCache& gc) const {
+	if (!gc.num_bad()) {
+		// e.g. the cache was updated, which takes no lock
+		::remove(bad_files_file(gc.name()).c_str());
+		return;
+	}
+	const int lock_fd = lock_bad_files(bad_files_file(gc.name()));
+	if (lock_fd < 0)
+		return;
+	replace_bad(gc);
+	::close(lock_fd);
+}
+
+void CDDB::DBCache::merge_bad(GenreCache& gc) const {
+	const std::string path = bad_files_file(gc.name());
+	const int lock_fd = lock_bad_files(path);
+	if (lock_fd < 0)
+		return;
+	std::ifstream is(path, std::ios::in | std::ios::binary);
+	if (is && !gc.merge_bad(is)) {
+		Tracer::_warn("ignoring invalid bad cddb files: ", path);
+	}
+	replace_bad(gc);
+	::close(lock_fd);
+}
+
+void CDDB::DBCache::replace_bad(const GenreCache& gc) const {
+	const std::string path = bad_files_file(gc.name());
+	if (!gc.num_bad()) {
+		::remove(path.c_str());
+		return;
+	}
+	// readers see the previous file or this one, never a part of it
+	const std::string tmp_path = path + "." + std::to_string(::getpid());
+	std::ofstream os(tmp_path, std::ios::binary);
+	gc.write_bad(os);
+	os.close();
+	if (os.fail() || ::rename(tmp_path.c_str(), path.c_str())) {
+		Tracer::_warn("failed to write the bad cddb files: ", path);
+		::remove(tmp_path.c_str());
+	}
+}
+
+bool CDDB::DBCache::init_random(bool skip_bad) {
+	const GenreWeights& genre_weights = m_cddb.genre_weights();
+	for (auto& gw : genre_weights) {
+		if (m_genres.end() == std::find_if(m_genres.begin(), m_genres.end(),
+				[&gw](const GenreCache& gc) {return gc.name() == gw.first;})) {
+			Tracer::_warn("genre weight set for unknown genre: ", gw.first);
+		}
+	}
+	std::vector<double> weights;
+	for (auto& gc : m_genres) {
+		gc.init_random(m_cddb.dedup_albums(), skip_bad, m_cddb.album_filter());
+		if (genre_weights.empty()) {
+			// every cddb file is equally likely
+			weights.push_back(gc.num_picks());
+		}
+		else {
+			auto gw = genre_weights.find(gc.name());
+			weights.push_back(gw != genre_weights.end() && gc.num_picks() ? gw->second : 0);
+		}
+		Tracer::_debug("genre weight: ", gc.name(), " = ", weights.back());
+	}
+	return m_genre_table.init(weights);
 }
 
 std::string CDDB::DBCache::random_file(RandomGenerator& rand) const {
-	return m_genres[m_random_dist(rand) - 1].random_file(rand);
+	return m_genres[m_genre_table(rand)].random_file(rand);
 }
 
 std::istream& operator >>(std::istream& is, CDDB::DBCache& cache) {
@@ -223,6 +467,15 @@ std::istream& operator >>(std::istream& is, CDDB::DBCache& cache) {
 		fs.exceptions(std::ios_base::failbit | std::ios_base::badbit);
 		fs.open(cache.genre_cache_file(name), std::ios::in | std::ios::binary);
 		fs >> gc;
+		// the album index is only read to be picked from, it is built again if it is missing or invalid
+		std::ifstream as(cache.album_index_file(name), std::ios::in | std::ios::binary);
+		if (cache.m_cddb.album_filter().is_set() && as && !gc.read_albums(as)) {
+			Tracer::_warn("ignoring invalid album index: ", cache.album_index_file(name));
+		}
+		std::ifstream bs(cache.bad_files_file(name), std::ios::in | std::ios::binary);
+		if (bs && !gc.read_bad(bs)) {
+			Tracer::_warn("ignoring invalid bad cddb files: ", cache.bad_files_file(name));
+		}
 		cache.m_genres.push_back(std::move(gc));
 	}
 	return is;
@@ -233,6 +486,21 @@ size_t CDDB::DBCache::size() const {
 			[](size_t sum, const GenreCache& genre) {return sum + genre.size();});
 }
 
+size_t CDDB::DBCache::num_bad() const {
+	return std::accumulate(m_genres.begin(), m_genres.end(), size_t(0),
+			[](size_t sum, const GenreCache& genre) {return sum + genre.num_bad();});
+}
+
+size_t CDDB::DBCache::num_picks() const {
+	return std::accumulate(m_genres.begin(), m_genres.end(), size_t(0),
+			[](size_t sum, const GenreCache& genre) {return sum + genre.num_picks();});
+}
+
+size_t CDDB::DBCache::bytes() const {
+	return std::accumulate(m_genres.begin(), m_genres.end(), size_t(0),
+			[](size_t sum, const GenreCache& genre) {return sum + genre.bytes();});
+}
+
 std::ostream& operator <<(std::ostream& os, const CDDB::DBCache& cache) {
 	os << cache.m_cddb.db_dir() << std::endl;
 	os << cache.m_genres.size() << std::endl;
@@ -241,6 +509,15 @@ std::ostream& operator <<(std::ostream& os, const CDDB::DBCache& cache) {
 		os << name << " " << gc.size() << std::endl;
 		std::ofstream fs(cache.genre_cache_file(name), std::ios::binary);
 		fs << gc;
+		if (gc.is_indexed()) {
+			std::ofstream as(cache.album_index_file(name), std::ios::binary);
+			gc.write_albums(as);
+		}
+		else {
+			// the index of the files of a previous cache
+			::remove(cache.album_index_file(name).c_str());
+		}
+		cache.write_bad(gc);
 	}
 	return os;
 }
@@ -249,12 +526,13 @@ std::ostream& operator <<(std::ostream& os, const CDDB::DBCache& cache) {
 // CDDB::GenreCache
 //-----------------------------------------------------------------------------
 CDDB::GenreCache::GenreCache(DBCache& db_cache, const std::string& dir_name) :
-		m_db_cache(db_cache), m_genre_dir_name(dir_name), m_entries(), m_random_dist() {
+		m_db_cache(db_cache), m_genre_dir_name(dir_name), m_scanned(), m_ids(), m_duplicates(), m_bad(), m_skipped(), m_albums(
+				), m_picks(), m_num_picks(0), m_random_dist() {
 }
 
 void CDDB::GenreCache::on_dir_begin(const Dir&) {
 
-	m_entries.clear();
+	m_scanned.clear();
 }
 
 // cddb file names are %08x formatted integers
@@ -277,8 +555,8 @@ Dir::EachResult CDDB::GenreCache::on_dir_entry(const Dir& /*dir*/, const dirent&
 		return Dir::EachResult::STOP;
 	uint32_t n = file_name_to_int(de.d_name);
 	if (n) {
-		m_entries.push_back(n);
-		std::cout << std::setw(12) << m_entries.size() << " " << de.d_name << "\r";
+		m_scanned.push_back(n);
+		std::cout << std::setw(12) << m_scanned.size() << " " << de.d_name << "\r";
 	}
 	else {
 		Tracer::_err("entry is not hex integer as expected ", de.d_name);
@@ -289,33 +567,111 @@ Dir::EachResult CDDB::GenreCache::on_dir_entry(const Dir& /*dir*/, const dirent&
 void CDDB::GenreCache::on_dir_end(const Dir& /*dir*/) {
 	// erase the output line
 	std::cout << std::setw(80) << std::setfill(' ') << "\r";
+	m_ids.assign(std::move(m_scanned));
+	m_scanned = std::vector<uint32_t>();
 }
 
-void CDDB::GenreCache::init_random() {
-	m_random_dist.param(RandomDistribution::param_type(1, size()));
+void CDDB::GenreCache::init_random(bool skip_duplicates, bool skip_bad, const AlbumIndex::Filter& filter) {
+	skip_duplicates = skip_duplicates && is_deduped() && num_duplicates();
+	skip_bad = skip_bad && num_bad();
+	m_skipped.reset(0);
+	if (skip_duplicates || skip_bad) {
+		m_skipped.reset(size());
+		if (skip_duplicates) {
+			m_skipped.merge(m_duplicates);
+		}
+		if (skip_bad) {
+			m_skipped.merge(m_bad);
+		}
+	}
+	m_picks.clear();
+	if (filter.is_set() && is_indexed()) {
+		m_albums.select(filter, m_skipped.count() ? &m_skipped : nullptr, m_picks);
+		m_picks.shrink_to_fit();
+		m_num_picks = m_picks.size();
+	}
+	else {
+		m_num_picks = size() - m_skipped.count();
+	}
+	// a genre without picks has weight 0
+	const size_t num_files = m_picks.empty() ? size() : m_picks.size();
+	m_random_dist.param(RandomDistribution::param_type(1, std::max<size_t>(1, num_files)));
 }
 
 std::string CDDB::GenreCache::random_file(RandomGenerator& rand) const {
-	uint32_t n = m_entries.at(m_random_dist(rand) - 1);
-	return m_db_cache.db_dir() + Dir::DIR_SEP + name() + Dir::DIR_SEP + int_to_file_name(n);
+	if (!m_picks.empty())
+		return file_path(m_picks[m_random_dist(rand) - 1]);
+	size_t index = m_random_dist(rand) - 1;
+	// the genre is not picked if all its files are skipped
+	while (m_skipped.count() && m_skipped.test(index)) {
+		index = m_random_dist(rand) - 1;
+	}
+	return file_path(index);
+}
+
+std::string CDDB::GenreCache::file_path(size_t index) const {
+	return m_db_cache.db_dir() + Dir::DIR_SEP + name() + Dir::DIR_SEP + int_to_file_name(m_ids.at(index));
 }
 
 std::istream& operator >>(std::istream& is, CDDB::GenreCache& cache) {
-	uint32_t count(0);
-	is.read((char*) &count, sizeof(count));
-	cache.m_entries.reserve(count);
-	while (count--) {
-		uint32_t n;
-		is.read((char*) &n, sizeof(n));
-		cache.m_entries.push_back(n);
+	if (!cache.m_ids.read(is)) {
+		// the raw ids of an older fmf, the cache is created again
+		throw std::runtime_error("unsupported genre cache format");
+	}
+	// the duplicates are marked only with --dedup-albums
+	if (is.peek() != std::char_traits<char>::eof() && !cache.m_duplicates.read(is, cache.size())) {
+		throw std::runtime_error("invalid duplicates in genre cache");
 	}
 	return is;
 }
 
+bool CDDB::GenreCache::mark_bad(const std::string& file_name) {
+	const uint32_t id = file_name_to_int(file_name.c_str());
+	const size_t index = id ? m_ids.find(id) : size();
+	if (index == size() || (m_bad.size() == size() && m_bad.test(index)))
+		return false;
+	if (m_bad.size() != size()) {
+		m_bad.reset(size());
+	}
+	m_bad.set(index);
+	return true;
+}
+
+bool CDDB::GenreCache::read_bad(std::istream& is) {
+	if (m_bad.read(is, size()))
+		return true;
+	m_bad.reset(0);
+	return false;
+}
+
+bool CDDB::GenreCache::merge_bad(std::istream& is) {
+	Bitmap bad;
+	if (!bad.read(is, size()))
+		return false;
+	if (m_bad.size() != size()) {
+		m_bad.reset(size());
+	}
+	m_bad.merge(bad);
+	return true;
+}
+
+void CDDB::GenreCache::write_bad(std::ostream& os) const {
+	m_bad.write(os);
+}
+
+bool CDDB::GenreCache::read_albums(std::istream& is) {
+	return m_albums.read(is, size());
+}
+
+void CDDB::GenreCache::write_albums(std::ostream& os) const {
+	m_albums.write(os);
+}
+
 std::ostream& operator <<(std::ostream& os, const CDDB::GenreCache& cache) {
-	uint32_t n = cache.m_entries.size();
-	os.write((char*) &n, sizeof(n));
-	os.write((char*) &cache.m_entries[0], cache.m_entries.size() * sizeof(uint32_t));
+	cache.m_ids.write(os);
+	if (cache.is_deduped()) {
+		cache.m_duplicates.write(os);
+	}
 	return os;
 }
 
@@ -22,8 +22,13 @@
 #ifndef FREEDB_H_
 #define FREEDB_H_
 
+#include "AlbumIndex.h"
+#include "AliasTable.h"
+#include "Bitmap.h"
 #include "Dir.h"
+#include "DiscIdList.h"
 
+#include <map>
 #include <string>
 #include <vector>
 #include <time.h>
@@ -35,6 +40,7 @@ namespace FMF {
 
 typedef std::default_random_engine RandomGenerator;
 typedef std::uniform_int_distribution<int> RandomDistribution;
+typedef std::map<std::string, double> GenreWeights;
 
 /**
  * free cddb directory with sub dir for each of 11 genres and files for each cd.
@@ -56,6 +62,41 @@ public:
 	 */
 	bool init(bool update_cache = false);
 
+	/**
+	 * set the relative weight of picking each genre.
+	 * must be called before init(). genres missing from a non empty @e weights are never picked.
+	 *
+	 * @param weights  genre dir name to weight. if empty genres are picked in proportion to their size.
+	 */
+	void set_genre_weights(const GenreWeights& weights) {
+		m_genre_weights = weights;
+	}
+
+	/**
+	 * never pick more than one cddb file of the same artist and album title.
+	 * must be called before init(). the duplicates are marked in the cache once, when it is created or on the first
+	 * init() with @e dedup set.
+	 */
+	void set_dedup_albums(bool dedup) {
+		m_dedup_albums = dedup;
+	}
+
+	/**
+	 * pick only the cddb files that match @e filter.
+	 * must be called before init(). the album index is built once, when the cache is created or on the first init()
+	 * with a filter set.
+	 */
+	void set_album_filter(const AlbumIndex::Filter& filter) {
+		m_album_filter = filter;
+	}
+
+	/**
+	 * seed the generator of random_file(), replacing the random seed
+	 */
+	void set_seed(uint32_t seed) {
+		m_prng.seed(seed);
+	}
+
 	/**
 	 * get the path for a random cddb file from a random genre.
 	 *
@@ -65,6 +106,14 @@ public:
 
 	size_t num_cached_files() const;
 
+	/**
+	 * mark the cddb files of @e paths, returned by random_file(), as bad and save the marks in the cache, so they are
+	 * never picked again. the marks are dropped when the cache is created again.
+	 *
+	 * @return number of files that were not marked before
+	 */
+	size_t mark_bad_files(const std::vector<std::string>& paths);
+
 private:
 	class DBCache;
 	friend std::istream& operator>>(std::istream& is, DBCache& cache);
@@ -86,6 +135,18 @@ private:
 		return m_cache_file_name;
 	}
 
+	const GenreWeights& genre_weights() const {
+		return m_genre_weights;
+	}
+
+	bool dedup_albums() const {
+		return m_dedup_albums;
+	}
+
+	const AlbumIndex::Filter& album_filter() const {
+		return m_album_filter;
+	}
+
 	class DBCache;
 
 	/**
@@ -98,25 +159,141 @@ private:
 		virtual Dir::EachResult on_dir_entry(const Dir& dir, const dirent& de);
 		virtual void on_dir_end(const Dir& dir);
 
-		void init_random();
+		/**
+		 * @param skip_duplicates  if true, random_file() never picks a file marked as duplicate
+		 * @param skip_bad         if true, random_file() never picks a file marked as bad
+		 * @param filter           random_file() picks only the files that match, if set
+		 */
+		void init_random(bool skip_duplicates, bool skip_bad, const AlbumIndex::Filter& filter);
+
+		/**
+		 * @return number of files random_file() picks from, after init_random()
+		 */
+		size_t num_picks() const {
+			return m_num_picks;
+		}
 
 		std::string random_file(RandomGenerator& rand) const;
 
+		/**
+		 * @return path of the file at @e index of the sorted ids
+		 */
+		std::string file_path(size_t index) const;
+
 		const std::string& name() const {
 			return m_genre_dir_name;
 		}
 
 		size_t size() const {
-			return m_entries.size();
+			return m_ids.size();
+		}
+
+		/**
+		 * @return size of the cached ids in memory
+		 */
+		size_t bytes() const {
+			return m_ids.bytes() + (m_duplicates.size() + m_bad.size() + m_skipped.size()) / 8 + m_albums.bytes()
+					+ m_picks.size() * sizeof(uint32_t);
+		}
+
+		/**
+		 * @return true if the duplicates were marked
+		 */
+		bool is_deduped() const {
+			return m_duplicates.size() == size();
+		}
+
+		/**
+		 * @return number of files marked as duplicate
+		 */
+		size_t num_duplicates() const {
+			return m_duplicates.count();
 		}
 
+		/**
+		 * clear the marks, is_deduped() is true after the call
+		 */
+		void reset_duplicates() {
+			m_duplicates.reset(size());
+		}
+
+		void mark_duplicate(size_t index) {
+			m_duplicates.set(index);
+		}
+
+		/**
+		 * @return true if the album index was built
+		 */
+		bool is_indexed() const {
+			return m_albums.size() == size();
+		}
+
+		/**
+		 * clear the album index, is_indexed() is true after the call
+		 */
+		void reset_albums() {
+			m_albums.reset(size());
+		}
+
+		void set_album(size_t index, const AlbumIndex::Album& album) {
+			m_albums.set(index, album);
+		}
+
+		/**
+		 * read the album index written by write_albums()
+		 *
+		 * @return false if it is not the index of the files of the genre
+		 */
+		bool read_albums(std::istream& is);
+
+		void write_albums(std::ostream& os) const;
+
+		/**
+		 * mark the file @e file_name as bad
+		 *
+		 * @return false if it is not a file of the genre or it was marked before
+		 */
+		bool mark_bad(const std::string& file_name);
+
+		size_t num_bad() const {
+			return m_bad.count();
+		}
+
+		/**
+		 * read the bad files written by write_bad()
+		 *
+		 * @return false if they are not of the files of the genre
+		 */
+		bool read_bad(std::istream& is);
+
+		/**
+		 * add the bad files written by write_bad(), e.g. by another process, to the bad files
+		 *
+		 * @return false if they are not of the files of the genre
+		 */
+		bool merge_bad(std::istream& is);
+
+		void write_bad(std::ostream& os) const;
+
 		friend std::istream& operator>>(std::istream& is, GenreCache& cache);
 		friend std::ostream& operator<<(std::ostream& os, const GenreCache& cache);
 
 	private:
 		DBCache& m_db_cache;
 		std::string m_genre_dir_name;
-		std::vector<uint32_t> m_entries;
+		/// the ids of the files, while the dir is scanned
+		std::vector<uint32_t> m_scanned;
+		DiscIdList m_ids;
+		/// files with the artist and title of a file of a lower index, by index of m_ids
+		Bitmap m_duplicates;
+		/// files that failed parsing, by index of m_ids
+		Bitmap m_bad;
+		/// the duplicates and the bad files not picked by random_file(), empty if none
+		Bitmap m_skipped;
+		AlbumIndex m_albums;
+		/// the indexes of the files that match the album filter, picked from instead of all files if the filter is set
+		std::vector<uint32_t> m_picks;
+		size_t m_num_picks;
 		mutable RandomDistribution m_random_dist;
 	};
 
@@ -130,6 +307,8 @@ private:
 
 		static bool read(CDDB::DBCache& cache, const std::string& cache_dir, const std::string& cache_file);
 
+		static bool write(const CDDB::DBCache& cache, const std::string& cache_dir, const std::string& cache_file);
+
 		virtual void on_dir_begin(const Dir& /*dir*/);
 
 		virtual Dir::EachResult on_dir_entry(const Dir& dir, const dirent& de);
@@ -138,12 +317,49 @@ private:
 
 		bool scan();
 
-		void init_random();
+		/**
+		 * read the DTITLE, DYEAR, DGENRE and track titles of all the files in parallel, build the album index of each
+		 * genre and mark every file with the artist and title of a file before it as duplicate
+		 *
+		 * @return false if interrupted
+		 */
+		bool index_albums();
+
+		bool is_deduped() const;
+
+		bool is_indexed() const;
+
+		size_t num_duplicates() const;
+
+		size_t num_bad() const;
+
+		/**
+		 * @return number of files picked from, after init_random()
+		 */
+		size_t num_picks() const;
+
+		/**
+		 * mark the files of @e paths as bad and write the bad files of the genres
+		 *
+		 * @return number of files that were not marked before
+		 */
+		size_t mark_bad_files(const std::vector<std::string>& paths);
+
+		/**
+		 * build the genre alias table from CDDB::genre_weights()
+		 *
+		 * @param skip_bad  if true, the files marked as bad are not picked
+		 *
+		 * @return false if no genre can be picked
+		 */
+		bool init_random(bool skip_bad = true);
 
 		std::string random_file(RandomGenerator& rand) const;
 
 		size_t size() const;
 
+		size_t bytes() const;
+
 		friend std::istream& operator>>(std::istream& is, DBCache& cache);
 		friend std::ostream& operator<<(std::ostream& os, const DBCache& cache);
 
@@ -154,6 +370,29 @@ private:
 			return cache_dir() + Dir::DIR_SEP + cache_file_name() + '.' + name;
 		}
 
+		std::string album_index_file(const std::string& name) const {
+			return genre_cache_file(name) + ".albums";
+		}
+
+		std::string bad_files_file(const std::string& name) const {
+			return genre_cache_file(name) + ".bad";
+		}
+
+		/**
+		 * write the bad files of @e gc, remove the file of the bad files if there are none
+		 */
+		void write_bad(const GenreCache& gc) const;
+
+		/**
+		 * add the bad files written by other processes since the cache was read to @e gc, then write them
+		 */
+		void merge_bad(GenreCache& gc) const;
+
+		/**
+		 * replace the file of the bad files of @e gc at once, with the lock of the file held
+		 */
+		void replace_bad(const GenreCache& gc) const;
+
 		const std::string& db_dir() const {
 			return m_cddb.db_dir();
 		}
@@ -168,7 +407,7 @@ private:
 
 		const CDDB& m_cddb;
 		std::vector<GenreCache> m_genres;
-		mutable RandomDistribution m_random_dist;
+		AliasTable m_genre_table;
 	};
 
 	std::string cddb_cache_file();
@@ -179,6 +418,9 @@ private:
 	const std::string m_db_dir;
 	const std::string m_cache_dir;
 	const std::string m_cache_file_name;
+	GenreWeights m_genre_weights;
+	bool m_dedup_albums;
+	AlbumIndex::Filter m_album_filter;
 	DBCache m_db_cache;
 	mutable RandomGenerator m_prng;
 };
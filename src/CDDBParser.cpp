@@ -26,6 +26,7 @@
 #include "File.h"
 #include "Utf8Converter.h"
 
+#include <stdio.h>
 #include <iosfwd>
 #include <fstream>
 #include <sstream>
@@ -35,6 +36,13 @@ namespace FMF {
 
 constexpr const char CDDBParser::VALUE_SEPARATOR[];
 
+/**
+ * comment lines of the disc toc: the offset of each track in frames of 1/75 second, then the disc length in seconds
+ */
+static constexpr const char TRACK_FRAME_OFFSETS[] = "# Track frame offsets:";
+static constexpr const char DISC_LENGTH[] = "# Disc length: %lu";
+static const size_t FRAMES_PER_SECOND = 75;
+
 /**
  * abstract base line parser.
  */
@@ -194,9 +202,10 @@ private:
 };
 
 CDDBParser::CDDBParser(Context& ctx) :
-		m_context(ctx), m_valid(false), m_dtitle_parser(new PlainKeywordParser("DTITLE=")), m_dyear_parser(
-				new PlainKeywordParser("DYEAR=")), m_dgenre_parser(new PlainKeywordParser("DGENRE=")), m_ttitle_parser(
-				new NumberedKeywordParser("TTITLE%d=")), m_parsers(), m_charset() {
+		m_context(ctx), m_valid(false), m_read_failed(false), m_dtitle_parser(new PlainKeywordParser("DTITLE=")),
+				m_dyear_parser(new PlainKeywordParser("DYEAR=")), m_dgenre_parser(new PlainKeywordParser("DGENRE=")),
+				m_ttitle_parser(new NumberedKeywordParser("TTITLE%d=")), m_parsers(), m_charset(), m_in_frame_offsets(false),
+				m_frame_offsets(), m_disc_length(0) {
 	m_parsers.push_back(m_dtitle_parser);
 	m_parsers.push_back(m_dyear_parser);
 	m_parsers.push_back(m_dgenre_parser);
@@ -217,8 +226,12 @@ bool CDDBParser::parse(const std::string& path) {
 	Tracer::_info("parsing: ", path);
 
 	// get the file contents into a string stream
-	File db_file(path);
-	std::istringstream content(db_file.read_all());
+	std::string data;
+	if (!File(path).read_all(data)) {
+		m_read_failed = true;
+		return false;
+	}
+	std::istringstream content(data);
 
 	// detect file's charset
 	EncodingDetector detector;
@@ -238,6 +251,7 @@ bool CDDBParser::parse(const std::string& path) {
 	while (content && parser != parse_end) {
 		// skip empty line (although are illegal in cddb) and comment lines
 		if (line.empty() || line.at(0) == '#') {
+			parse_comment(line);
 			std::getline(content, line);
 			continue;
 		}
@@ -267,9 +281,40 @@ bool CDDBParser::parse(const std::string& path) {
 	return m_valid;
 }
 
+void CDDBParser::parse_comment(const std::string& line) {
+	unsigned long value;
+	if (!line.compare(0, sizeof(TRACK_FRAME_OFFSETS) - 1, TRACK_FRAME_OFFSETS)) {
+		m_in_frame_offsets = true;
+		return;
+	}
+	if (m_in_frame_offsets && 1 == ::sscanf(line.c_str(), "#%lu", &value)) {
+		m_frame_offsets.push_back(value);
+		return;
+	}
+	m_in_frame_offsets = false;
+	if (1 == ::sscanf(line.c_str(), DISC_LENGTH, &value)) {
+		m_disc_length = value;
+	}
+}
+
+size_t CDDBParser::track_duration_ms(size_t index) const {
+	if (index >= m_frame_offsets.size() || !m_disc_length) {
+		return 0;
+	}
+	const size_t end = (index + 1 < m_frame_offsets.size()) ? m_frame_offsets[index + 1] : m_disc_length * FRAMES_PER_SECOND;
+	if (end <= m_frame_offsets[index]) {
+		return 0;
+	}
+	return (end - m_frame_offsets[index]) * 1000 / FRAMES_PER_SECOND;
+}
+
 void CDDBParser::reset() {
 	m_valid = false;
+	m_read_failed = false;
 	m_db_file.clear();
+	m_in_frame_offsets = false;
+	m_frame_offsets.clear();
+	m_disc_length = 0;
 	for (auto parser : m_parsers) {
 		parser->reset();
 	}
@@ -290,8 +335,10 @@ std::vector<TrackInfo> CDDBParser::getTracks() const {
 	size_t track_num = 1;
 	const bool skip_empty_titles = m_context.options().skip_empty_titles();
 	auto titles = m_ttitle_parser->values();
-	for (auto& track_title_value : titles) {
-		auto track_artist_title = splitValue(track_title_value);
+	// durations are known only if there is a frame offset for each track
+	const bool has_durations = m_frame_offsets.size() == titles.size();
+	for (size_t index = 0; index < titles.size(); index++) {
+		auto track_artist_title = splitValue(titles[index]);
 		if (skip_empty_titles && track_artist_title.second.empty()) {
 			continue;
 		}
@@ -308,6 +355,7 @@ std::vector<TrackInfo> CDDBParser::getTracks() const {
 		ti.set_genre(disk_genre);
 		ti.set_track_num(track_num++);
 		ti.set_tracks_total(titles.size());
+		ti.set_duration_ms(has_durations ? track_duration_ms(index) : 0);
 		tracks.push_back(ti);
 	}
 	return tracks;
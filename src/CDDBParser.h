@@ -65,6 +65,13 @@ public:
 	 */
 	bool parse(const std::string& path);
 
+	/**
+	 * @return true if the last parse() failed because the file could not be read, not because it is invalid
+	 */
+	bool is_read_failed() const {
+		return m_read_failed;
+	}
+
 	/**
 	 * get tracks info after successful parse
 	 */
@@ -78,6 +85,16 @@ private:
 	 */
 	void reset();
 
+	/**
+	 * parse the track frame offsets and the disc length from the comment lines
+	 */
+	void parse_comment(const std::string& line);
+
+	/**
+	 * @return the duration of track @e index from the frame offsets and the disc length, 0 if unknown
+	 */
+	size_t track_duration_ms(size_t index) const;
+
 	/**
 	 * splits {@e value} on a " / " token.
 	 *
@@ -89,6 +106,8 @@ private:
 
 	bool m_valid;
 
+	bool m_read_failed;
+
 	std::string m_db_file;
 
 	PlainKeywordParser* m_dtitle_parser;
@@ -99,6 +118,10 @@ private:
 	std::vector<KeywordParser*> m_parsers;
 
 	std::string m_charset;
+
+	bool m_in_frame_offsets;
+	std::vector<size_t> m_frame_offsets;
+	size_t m_disc_length;
 };
 
 } /* namespace fmf */
@@ -31,29 +31,85 @@ namespace FMF {
 
 /*static*/bool Context::s_signaled = false;
 
+static const char* s_stage_names[] = { "pick", "parse", "mkdir", "copy", "tag", "sync" };
+
+/*static*/const char* Context::stage_name(Stage stage) {
+	return s_stage_names[static_cast<size_t>(stage)];
+}
+
 Context::Context(const Options& opts) :
-		m_opts(opts), m_cddb(nullptr), m_parse_counts_mutex(), m_parse_success(0), m_parse_pending(0), m_parse_failed(
-				0), m_parse_failed_files(), m_create_success(0), m_create_failed(0), m_create_skipped(0) {
+		m_opts(opts), m_cddb(nullptr), m_synthetic(nullptr), m_parse_counts_mutex(), m_parse_success(0), m_parse_pending(0),
+				m_parse_failed(0), m_parse_failed_files(), m_bad_files(), m_create_success(0), m_create_failed(0),
+				m_create_skipped(0), m_bytes_written(0), m_tuned_threads(0) {
+	for (auto& ns : m_stage_ns) {
+		ns = 0;
+	}
 }
 
 Context::~Context() {
 	delete m_cddb;
+	delete m_synthetic;
 }
 
 bool Context::init() {
+	if (m_opts.is_synthetic_set()) {
+		m_synthetic = new (std::nothrow) SyntheticAlbums(m_opts.synthetic_params(), m_opts.seed());
+		return m_synthetic;
+	}
 	if (m_opts.is_db_dir_set()) {
 		m_cddb = new (std::nothrow) CDDB(m_opts.db_dir());
-		return m_cddb && m_cddb->init(m_opts.update_cache());
+		if (!m_cddb)
+			return false;
+		m_cddb->set_genre_weights(m_opts.genre_weights());
+		m_cddb->set_dedup_albums(m_opts.dedup_albums());
+		m_cddb->set_album_filter(m_opts.album_filter());
+		m_cddb->set_seed(m_opts.seed());
+		return m_cddb->init(m_opts.update_cache());
 	}
 	return true;
 }
 
+void Context::reset() {
+	std::lock_guard < std::mutex > locker(m_parse_counts_mutex);
+	if (m_synthetic) {
+		delete m_synthetic;
+		m_synthetic = new SyntheticAlbums(m_opts.synthetic_params(), m_opts.seed());
+	}
+	if (m_cddb) {
+		m_cddb->set_seed(m_opts.seed());
+	}
+	m_parse_success = 0;
+	m_parse_pending = 0;
+	m_parse_failed = 0;
+	m_parse_failed_files.clear();
+	m_bad_files.clear();
+	m_create_success = 0;
+	m_create_failed = 0;
+	m_create_skipped = 0;
+	m_bytes_written = 0;
+	for (auto& ns : m_stage_ns) {
+		ns = 0;
+	}
+	m_tuned_threads = 0;
+}
+
+void Context::mark_bad_files() {
+	if (m_cddb && !m_bad_files.empty()) {
+		m_cddb->mark_bad_files(m_bad_files);
+	}
+}
+
 bool Context::pick_db_file(std::string& db_file_path) {
 	std::lock_guard < std::mutex > locker(m_parse_counts_mutex);
 	if (m_parse_success + m_parse_pending >= m_opts.num_albums() || m_parse_failed >= m_opts.num_albums()) {
 		return false;
 	}
-	db_file_path = m_opts.is_db_file_set() ? m_opts.db_file() : m_cddb->random_file();
+	if (m_synthetic) {
+		db_file_path = m_synthetic->next_album();
+	}
+	else {
+		db_file_path = m_opts.is_db_file_set() ? m_opts.db_file() : m_cddb->random_file();
+	}
 	m_parse_pending += 1;
 	return true;
 }
@@ -65,11 +121,16 @@ size_t Context::on_parse_success() {
 	return m_parse_success;
 }
 
-size_t Context::on_parse_failed(const std::string& db_file) {
+size_t Context::on_parse_failed(const std::string& db_file, ParseFailure failure) {
 	std::lock_guard < std::mutex > locker(m_parse_counts_mutex);
 	m_parse_failed += 1;
 	m_parse_pending -= 1;
-	m_parse_failed_files.push_back(db_file);
+	if (failure != ParseFailure::MISSING) {
+		m_parse_failed_files.push_back(db_file);
+	}
+	if (failure == ParseFailure::INVALID) {
+		m_bad_files.push_back(db_file);
+	}
 	return m_parse_failed;
 }
 
@@ -87,6 +148,9 @@ std::ostream& FMF::Context::output_summary(std::ostream& os) const {
 																	parse_fail_count()),
 															std::make_pair("Failed fake music files",
 																	create_failed_count()) };
+	if (m_tuned_threads) {
+		titles.push_back(std::make_pair("Threads chosen by --threads=auto", m_tuned_threads));
+	}
 
 	const size_t max_title_len = std::max_element(titles.begin(), titles.end(),
 			[](const std::pair<std::string, size_t>& t1, const std::pair<std::string, size_t>& t2) {
@@ -98,6 +162,10 @@ std::ostream& FMF::Context::output_summary(std::ostream& os) const {
 	if (Context::stopped()) {
 		os << "Stopped by signal" << std::endl;
 	}
+	if (m_opts.dry_run() != MusicFileCreator::DryRun::NONE) {
+		os << "Dry run --dry-run=" << MusicFileCreator::dry_run_name(m_opts.dry_run()) << ", no music files were written"
+				<< std::endl;
+	}
 	os << "Results:" << std::endl;
 	os << std::setw(max_num_len + max_title_len) << std::setfill('-') << "" << std::endl;
 
@@ -106,7 +174,7 @@ std::ostream& FMF::Context::output_summary(std::ostream& os) const {
 				<< pair.first << std::setw(max_num_len) << std::right << pair.second << std::endl;
 	}
 
-	if (m_parse_failed) {
+	if (!m_parse_failed_files.empty()) {
 		os << std::setw(max_num_len + max_title_len) << std::setfill('-') << "" << std::endl;
 		os << "Failed to parse these db files:" << std::endl;
 		for (auto& fpath : m_parse_failed_files)
@@ -24,9 +24,12 @@
 
 #include "Options.h"
 #include "CDDB.h"
+#include "SyntheticAlbums.h"
 #include "Tracer.h"
 
+#include <stdint.h>
 #include <atomic>
+#include <chrono>
 #include <mutex>
 #include <vector>
 #include <iomanip>
@@ -40,17 +43,66 @@ namespace FMF {
  */
 class Context {
 public:
+	/**
+	 * stages of creating music files, timed for option --benchmark
+	 */
+	enum class Stage {
+		PICK, PARSE, MKDIR, COPY, TAG, SYNC, NUM_STAGES
+	};
+
+	static const char* stage_name(Stage stage);
+
+	/**
+	 * adds the time from construction to destruction to the time of a stage
+	 */
+	class StageTimer {
+	public:
+		StageTimer(Context& ctx, Stage stage) :
+				m_context(ctx), m_stage(stage), m_start(std::chrono::steady_clock::now()) {
+		}
+		~StageTimer() {
+			m_context.add_stage_time(m_stage, std::chrono::steady_clock::now() - m_start);
+		}
+	private:
+		Context& m_context;
+		const Stage m_stage;
+		const std::chrono::steady_clock::time_point m_start;
+	};
+
 	Context(const Options& opts);
 
 	~Context();
 
 	bool init();
 
+	/**
+	 * start a new run with the current options, for Engine: the counters are cleared and the loaded
+	 * index picks again from the Options::seed()
+	 */
+	void reset();
+
+	/**
+	 * mark the cddb files that failed parsing in this run as bad in the cddb cache, so no later run picks them
+	 */
+	void mark_bad_files();
+
 	bool pick_db_file(std::string& db_file_path);
 
 	size_t on_parse_success();
 
-	size_t on_parse_failed(const std::string& db_file);
+	/**
+	 * why a db file failed, only INVALID files are marked as bad in the cddb cache
+	 */
+	enum class ParseFailure {
+		/// the content is not a cddb file, or its charset can't be converted
+		INVALID,
+		/// the file could not be read, which may not happen again
+		UNREADABLE,
+		/// the file is not in the cddb dir anymore, the cache is stale. not listed in the summary
+		MISSING
+	};
+
+	size_t on_parse_failed(const std::string& db_file, ParseFailure failure = ParseFailure::INVALID);
 
 	size_t on_create_success() {
 		int output_interval = m_opts.num_albums() > 200 ? 1000 : 100;
@@ -68,6 +120,28 @@ public:
 		return ++m_create_skipped;
 	}
 
+	void on_bytes_written(size_t bytes) {
+		m_bytes_written += bytes;
+	}
+
+	void add_stage_time(Stage stage, std::chrono::steady_clock::duration time) {
+		m_stage_ns[static_cast<size_t>(stage)] += std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+	}
+
+	/**
+	 * @return the time of @e stage summed over all threads
+	 */
+	std::chrono::nanoseconds stage_time(Stage stage) const {
+		return std::chrono::nanoseconds(m_stage_ns[static_cast<size_t>(stage)]);
+	}
+
+	/**
+	 * @return size of the created music files
+	 */
+	uint64_t bytes_written() const {
+		return m_bytes_written;
+	}
+
 	size_t parse_success_count() const {
 		return m_parse_success;
 	}
@@ -88,10 +162,24 @@ public:
 		return m_create_skipped;
 	}
 
+	/**
+	 * set the number of threads chosen by option --threads=auto, output in the summary
+	 */
+	void set_tuned_threads(size_t num_threads) {
+		m_tuned_threads = num_threads;
+	}
+
 	const Options& options() const {
 		return m_opts;
 	}
 
+	/**
+	 * @return the albums generator if option --synthetic is set, else null
+	 */
+	const SyntheticAlbums* synthetic_albums() const {
+		return m_synthetic;
+	}
+
 	std::ostream& output_summary(std::ostream& os) const;
 
 	static bool stopped() {
@@ -105,6 +193,7 @@ public:
 private:
 	const Options& m_opts;
 	CDDB* m_cddb;
+	SyntheticAlbums* m_synthetic;
 
 	std::mutex m_parse_counts_mutex;
 	size_t m_parse_success;
@@ -112,10 +201,15 @@ private:
 	size_t m_parse_failed;
 
 	std::vector<std::string> m_parse_failed_files;
+	/// the ParseFailure::INVALID files, marked as bad by mark_bad_files()
+	std::vector<std::string> m_bad_files;
 
 	std::atomic<size_t> m_create_success;
 	std::atomic<size_t> m_create_failed;
 	std::atomic<size_t> m_create_skipped;
+	std::atomic<uint64_t> m_bytes_written;
+	std::atomic<uint64_t> m_stage_ns[static_cast<size_t>(Stage::NUM_STAGES)];
+	size_t m_tuned_threads;
 
 	static bool s_signaled;
 };
@@ -0,0 +1,287 @@
+/*
+ * Daemon.cpp
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#include "Daemon.h"
+#include "Context.h"
+#include "MusicFileCreator.h"
+#include "Options.h"
+#include "Tracer.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+
+namespace FMF {
+
+/*static*/const std::chrono::milliseconds Daemon::PROGRESS_INTERVAL(250);
+
+//-----------------------------------------------------------------------------
+// Daemon::Job
+//-----------------------------------------------------------------------------
+Daemon::Job::Job(const Options& opts) :
+		output_dir(), run(opts.num_albums(), opts.is_seed_set() ? opts.seed() : std::random_device()()) {
+	run.layout = MusicFileCreator::layout_name(opts.layout());
+}
+
+bool Daemon::Job::parse(const std::string& line, std::string& error) {
+	std::istringstream is(line);
+	std::string item;
+	while (std::getline(is, item, ',')) {
+		auto pos = item.find('=');
+		std::string key = item.substr(0, pos);
+		std::string value = (pos == std::string::npos) ? "" : item.substr(pos + 1);
+		bool ok = !value.empty();
+		if (key == "out") {
+			char buf[PATH_MAX];
+			struct stat sb;
+			ok = ok && ::realpath(value.c_str(), buf) && ::stat(buf, &sb) == 0 && S_ISDIR(sb.st_mode)
+					&& ::access(buf, W_OK) == 0;
+			if (ok) {
+				output_dir = buf;
+			}
+		}
+		else if (key == "albums") {
+			unsigned long n;
+			int end = 0;
+			ok = ok && 1 == ::sscanf(value.c_str(), "%lu%n", &n, &end) && end == (int) value.size() && n > 0
+					&& n <= static_cast<unsigned long>(Options::MAX_CDS);
+			run.num_albums = n;
+		}
+		else if (key == "seed") {
+			unsigned long n;
+			int end = 0;
+			ok = ok && 1 == ::sscanf(value.c_str(), "%lu%n", &n, &end) && end == (int) value.size() && n <= UINT32_MAX;
+			run.seed = n;
+		}
+		else if (key == "layout") {
+			MusicFileCreator::Layout layout;
+			ok = MusicFileCreator::parse_layout(value, layout);
+			run.layout = value;
+		}
+		else {
+			ok = false;
+		}
+		if (!ok) {
+			error = "invalid parameter \"" + item + "\"";
+			return false;
+		}
+	}
+	if (output_dir.empty()) {
+		error = "missing out=<dir>";
+		return false;
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Daemon
+//-----------------------------------------------------------------------------
+Daemon::Daemon(const Options& opts) :
+		m_opts(opts), m_engine(), m_socket_path(opts.daemon_socket()), m_socket(-1), m_num_jobs(0) {
+}
+
+Daemon::~Daemon() {
+	if (m_socket >= 0) {
+		::close(m_socket);
+		::unlink(m_socket_path.c_str());
+	}
+}
+
+bool Daemon::run() {
+	if (!m_engine.open(m_opts))
+		return false;
+	if (!listen())
+		return false;
+	Tracer::cout("Listening for jobs on ", m_socket_path);
+
+	while (!Context::stopped()) {
+		int fd = ::accept4(m_socket, nullptr, nullptr, SOCK_CLOEXEC);
+		if (fd < 0) {
+			// interrupted by the signal that stops the daemon
+			if (errno != EINTR && errno != ECONNABORTED) {
+				Tracer::_err("failed to accept a connection on ", m_socket_path, ": ", ::strerror(errno));
+				return false;
+			}
+			continue;
+		}
+		serve(fd);
+		::close(fd);
+	}
+	Tracer::cout("Stopped after ", m_num_jobs, " jobs");
+	return true;
+}
+
+bool Daemon::listen() {
+	struct sockaddr_un addr;
+	::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (m_socket_path.size() >= sizeof(addr.sun_path)) {
+		Tracer::_err("socket path ", m_socket_path, " is longer than ", sizeof(addr.sun_path) - 1);
+		return false;
+	}
+	::strncpy(addr.sun_path, m_socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+	struct stat sb;
+	if (::lstat(m_socket_path.c_str(), &sb) == 0) {
+		// left by a daemon that did not exit cleanly
+		if (!S_ISSOCK(sb.st_mode)) {
+			Tracer::_err(m_socket_path, " exists and is not a socket");
+			return false;
+		}
+		if (sb.st_uid != ::geteuid()) {
+			Tracer::_err(m_socket_path, " exists and is owned by another user");
+			return false;
+		}
+		::unlink(m_socket_path.c_str());
+	}
+
+	int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		Tracer::_err("failed to create the socket: ", ::strerror(errno));
+		return false;
+	}
+	// only the user of the daemon may connect, the socket is created with mode 0600
+	mode_t old_umask = ::umask(0177);
+	int bound = ::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+	::umask(old_umask);
+	if (bound || ::listen(fd, SOMAXCONN)) {
+		Tracer::_err("failed to listen on ", m_socket_path, ": ", ::strerror(errno));
+		::close(fd);
+		return false;
+	}
+	m_socket = fd;
+	return true;
+}
+
+void Daemon::serve(int fd) {
+	std::string buf;
+	char data[1024];
+	while (!Context::stopped()) {
+		size_t eol;
+		while ((eol = buf.find('\n')) != std::string::npos) {
+			std::string line = buf.substr(0, eol);
+			buf.erase(0, eol + 1);
+			if (!line.empty() && line.back() == '\r') {
+				line.pop_back();
+			}
+			if (line.empty())
+				continue;
+			Job job(m_opts);
+			std::string error;
+			if (!job.parse(line, error)) {
+				Tracer::_warn("invalid job \"", line, "\": ", error);
+				send_line(fd, "error " + error);
+				continue;
+			}
+			run_job(fd, job);
+			if (Context::stopped())
+				return;
+		}
+		if (buf.size() > MAX_LINE) {
+			send_line(fd, "error job line is too long");
+			return;
+		}
+		ssize_t n = ::recv(fd, data, sizeof(data), 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return;
+		buf.append(data, n);
+	}
+}
+
+void Daemon::run_job(int fd, const Job& job) {
+	m_num_jobs++;
+	Tracer::cout("Job ", m_num_jobs, ": ", job.run.num_albums, " albums to ", job.output_dir, ", seed ", job.run.seed,
+			", layout ", job.run.layout);
+
+	auto results_line = [](const char* state, const Engine::Results& results) {
+		char line[256];
+		::snprintf(line, sizeof(line), "%s created=%zu skipped=%zu failed=%zu", state, results.created,
+				results.skipped, results.failed);
+		return std::string(line);
+	};
+
+	// the progress is sent from its own thread while the engine runs the job
+	std::mutex lock;
+	std::condition_variable cond;
+	bool done = false;
+	std::thread progress([&]() {
+		std::unique_lock < std::mutex > locker(lock);
+		while (!cond.wait_for(locker, PROGRESS_INTERVAL, [&done]() {return done;})) {
+			send_line(fd, results_line("progress", m_engine.progress()));
+		}
+	});
+
+	Engine::Results results;
+	const bool finished = m_engine.generate(job.run, job.output_dir, results);
+
+	{
+		std::lock_guard < std::mutex > locker(lock);
+		done = true;
+	}
+	cond.notify_one();
+	progress.join();
+
+	if (Context::stopped()) {
+		send_line(fd, "error stopped by signal");
+		return;
+	}
+	if (!finished) {
+		send_line(fd, "error failed to finish the music files, see the output of the daemon");
+		return;
+	}
+	char line[128];
+	::snprintf(line, sizeof(line), " bytes=%llu seconds=%.3f", static_cast<unsigned long long>(results.bytes),
+			results.seconds);
+	const std::string done_line = results_line("done", results) + line;
+	Tracer::cout("Job ", m_num_jobs, " ", done_line);
+	send_line(fd, done_line);
+}
+
+/*static*/bool Daemon::send_line(int fd, const std::string& line) {
+	std::string data = line + '\n';
+	size_t sent = 0;
+	while (sent < data.size()) {
+		// no SIGPIPE if the client is gone
+		ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		sent += n;
+	}
+	return true;
+}
+
+} /* namespace FMF */
@@ -0,0 +1,110 @@
+/*
+ * Daemon.h
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#ifndef DAEMON_H_
+#define DAEMON_H_
+
+#include "Engine.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <chrono>
+#include <string>
+
+namespace FMF {
+
+class Options;
+
+/**
+ * keeps an Engine open, with the CDDB index and the templates loaded, and runs generation jobs sent over a local
+ * unix socket, set by option --daemon=<socket path>.
+ *
+ * a job is a line of comma separated key=value: out=<dir>,albums=<n>[,seed=<n>][,layout=<layout>]. the jobs run one
+ * at a time, each as an Engine::Run. while a job runs the daemon sends
+ * "progress created=<n> skipped=<n> failed=<n>" lines every PROGRESS_INTERVAL, then a "done ..." line with the
+ * results, or an "error <message>" line if the job is invalid. a client may send more jobs on the same connection.
+ */
+class Daemon {
+public:
+	/**
+	 * a generation job, the keys not sent are the ones of the options of the daemon
+	 */
+	struct Job {
+		Job(const Options& opts);
+
+		/**
+		 * parse a comma separated list of key=value
+		 *
+		 * @param error	set to the reason if @e line is invalid
+		 *
+		 * @return false if @e line is invalid
+		 */
+		bool parse(const std::string& line, std::string& error);
+
+		std::string output_dir;
+		Engine::Run run;
+	};
+
+	Daemon(const Options& opts);
+	~Daemon();
+
+	/**
+	 * load the index and the templates, then serve jobs until stopped by a signal
+	 *
+	 * @return false if loading failed or the socket could not be listened on
+	 */
+	bool run();
+
+private:
+	Daemon(const Daemon&) = delete;
+	Daemon& operator=(const Daemon&) = delete;
+
+	bool listen();
+
+	/**
+	 * run the jobs sent on connection @e fd until the client closes it
+	 */
+	void serve(int fd);
+
+	/**
+	 * run @e job, sending its progress and results to @e fd
+	 */
+	void run_job(int fd, const Job& job);
+
+	/**
+	 * @return false if sending failed, the client is gone
+	 */
+	static bool send_line(int fd, const std::string& line);
+
+	/// how often the progress of a job is sent
+	static const std::chrono::milliseconds PROGRESS_INTERVAL;
+	/// longest job line accepted
+	static const size_t MAX_LINE = 4096;
+
+	const Options& m_opts;
+	Engine m_engine;
+	const std::string m_socket_path;
+	int m_socket;
+	size_t m_num_jobs;
+};
+
+} /* namespace FMF */
+#endif /* DAEMON_H_ */
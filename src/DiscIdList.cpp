@@ -0,0 +1,145 @@
+/*
+ * DiscIdList.cpp
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#include "DiscIdList.h"
+
+#include <algorithm>
+#include <istream>
+#include <ostream>
+
+namespace FMF {
+
+/// "FMFI" and the version of the format
+static const uint32_t MAGIC = 0x49464D46;
+static const uint32_t VERSION = 1;
+
+static void put_varint(std::vector<uint8_t>& out, uint32_t n) {
+	while (n >= 0x80) {
+		out.push_back(0x80 | (n & 0x7F));
+		n >>= 7;
+	}
+	out.push_back(n);
+}
+
+static uint32_t get_varint(const uint8_t*& in) {
+	uint32_t n = 0;
+	for (int shift = 0;; shift += 7) {
+		const uint8_t b = *in++;
+		n |= uint32_t(b & 0x7F) << shift;
+		if (!(b & 0x80))
+			return n;
+	}
+}
+
+template<typename T>
+static void write_value(std::ostream& os, const T& value) {
+	os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template<typename T>
+static bool read_value(std::istream& is, T& value) {
+	return static_cast<bool>(is.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+DiscIdList::DiscIdList() :
+		m_blocks(), m_data(), m_size(0) {
+}
+
+DiscIdList::~DiscIdList() {
+}
+
+void DiscIdList::assign(std::vector<uint32_t> ids) {
+	std::sort(ids.begin(), ids.end());
+	m_blocks.clear();
+	m_data.clear();
+	m_size = ids.size();
+	for (size_t i = 0; i < ids.size(); i++) {
+		if (i % BLOCK_SIZE == 0) {
+			m_blocks.push_back(Block { ids[i], static_cast<uint32_t>(m_data.size()) });
+		}
+		else {
+			put_varint(m_data, ids[i] - ids[i - 1]);
+		}
+	}
+	m_blocks.shrink_to_fit();
+	m_data.shrink_to_fit();
+}
+
+uint32_t DiscIdList::at(size_t index) const {
+	const Block& block = m_blocks[index / BLOCK_SIZE];
+	uint32_t id = block.first;
+	const uint8_t* in = m_data.data() + block.offset;
+	for (size_t i = index % BLOCK_SIZE; i > 0; i--) {
+		id += get_varint(in);
+	}
+	return id;
+}
+
+size_t DiscIdList::find(uint32_t id) const {
+	auto it = std::upper_bound(m_blocks.begin(), m_blocks.end(), id,
+			[](uint32_t n, const Block& block) {return n < block.first;});
+	if (it == m_blocks.begin())
+		return m_size;
+	const size_t b = it - m_blocks.begin() - 1;
+	const size_t end = std::min(m_size, (b + 1) * BLOCK_SIZE);
+	uint32_t n = m_blocks[b].first;
+	const uint8_t* in = m_data.data() + m_blocks[b].offset;
+	for (size_t index = b * BLOCK_SIZE; index < end && n <= id; index++) {
+		if (n == id)
+			return index;
+		if (index + 1 < end) {
+			n += get_varint(in);
+		}
+	}
+	return m_size;
+}
+
+size_t DiscIdList::bytes() const {
+	return m_blocks.size() * sizeof(Block) + m_data.size();
+}
+
+bool DiscIdList::read(std::istream& is) {
+	uint32_t magic, version, size, num_blocks, data_size;
+	if (!read_value(is, magic) || magic != MAGIC || !read_value(is, version) || version != VERSION)
+		return false;
+	if (!read_value(is, size) || !read_value(is, num_blocks) || !read_value(is, data_size)
+			|| num_blocks != (size + BLOCK_SIZE - 1) / BLOCK_SIZE)
+		return false;
+	m_blocks.resize(num_blocks);
+	m_data.resize(data_size);
+	is.read(reinterpret_cast<char*>(m_blocks.data()), num_blocks * sizeof(Block));
+	is.read(reinterpret_cast<char*>(m_data.data()), data_size);
+	m_size = size;
+	return is && std::all_of(m_blocks.begin(), m_blocks.end(), [data_size](const Block& block) {
+		return block.offset <= data_size;});
+}
+
+void DiscIdList::write(std::ostream& os) const {
+	write_value(os, MAGIC);
+	write_value(os, VERSION);
+	write_value(os, static_cast<uint32_t>(m_size));
+	write_value(os, static_cast<uint32_t>(m_blocks.size()));
+	write_value(os, static_cast<uint32_t>(m_data.size()));
+	os.write(reinterpret_cast<const char*>(m_blocks.data()), m_blocks.size() * sizeof(Block));
+	os.write(reinterpret_cast<const char*>(m_data.data()), m_data.size());
+}
+
+} /* namespace FMF */
@@ -0,0 +1,97 @@
+/*
+ * DiscIdList.h
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#ifndef DISCIDLIST_H_
+#define DISCIDLIST_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <iosfwd>
+#include <vector>
+
+namespace FMF {
+
+/**
+ * sorted cddb disc ids, the file names of a genre dir, delta and varint encoded in blocks of BLOCK_SIZE ids.
+ *
+ * the first id and the data offset of each block are kept in a skip index, so the id at an index is found by
+ * decoding one block, and the index of an id by a binary search of the skip index and decoding one block.
+ * the ids of a genre are spread over 32 bits, most deltas take 2 or 3 bytes instead of 4.
+ */
+class DiscIdList {
+public:
+	DiscIdList();
+	~DiscIdList();
+
+	/**
+	 * replace the ids with @e ids, which are sorted
+	 */
+	void assign(std::vector<uint32_t> ids);
+
+	size_t size() const {
+		return m_size;
+	}
+
+	/**
+	 * @return the id at @e index in ascending order, @e index < size()
+	 */
+	uint32_t at(size_t index) const;
+
+	/**
+	 * @return the index of @e id, size() if it is not in the list
+	 */
+	size_t find(uint32_t id) const;
+
+	bool contains(uint32_t id) const {
+		return find(id) < m_size;
+	}
+
+	/**
+	 * @return size of the encoded ids and the skip index in bytes
+	 */
+	size_t bytes() const;
+
+	/**
+	 * read the list written by write()
+	 *
+	 * @return false if the data is not a list of this format
+	 */
+	bool read(std::istream& is);
+
+	void write(std::ostream& os) const;
+
+	/// number of ids in a block, the most decoded to find one
+	static const size_t BLOCK_SIZE = 128;
+
+private:
+	struct Block {
+		uint32_t first;
+		/// offset of the deltas after the first id in m_data
+		uint32_t offset;
+	};
+
+	std::vector<Block> m_blocks;
+	std::vector<uint8_t> m_data;
+	size_t m_size;
+};
+
+} /* namespace FMF */
+#endif /* DISCIDLIST_H_ */
@@ -0,0 +1,199 @@
+/*
+ * Engine.cpp
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#include "Engine.h"
+#include "config.h"
+#include "Context.h"
+#include "Launcher.h"
+#include "MusicFileCreator.h"
+#include "MusicFilesGenerator.h"
+#include "Options.h"
+#include "Tracer.h"
+
+#include <getopt.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+
+namespace FMF {
+
+//-----------------------------------------------------------------------------
+// Engine::Run
+//-----------------------------------------------------------------------------
+Engine::Run::Run(size_t num_albums, uint32_t seed) :
+		num_albums(num_albums), seed(seed), layout() {
+}
+
+//-----------------------------------------------------------------------------
+// Engine::Results
+//-----------------------------------------------------------------------------
+Engine::Results::Results() :
+		created(0), skipped(0), failed(0), bytes(0), seconds(0) {
+}
+
+//-----------------------------------------------------------------------------
+// Engine
+//-----------------------------------------------------------------------------
+Engine::Engine() :
+		m_opts(), m_layout(), m_context(), m_creator() {
+}
+
+Engine::~Engine() {
+}
+
+bool Engine::open(const std::vector<std::string>& args) {
+	m_opts.reset(new Options());
+	m_opts->set_engine();
+	std::string prog_name(PACKAGE_NAME);
+	std::vector<std::string> args_copy(args);
+	std::vector<char*> argv { &prog_name[0] };
+	for (auto& arg : args_copy) {
+		argv.push_back(&arg[0]);
+	}
+	argv.push_back(nullptr);
+	// getopt starts over, the options may have been parsed before, and its state is restored for the host
+	const int optind = ::optind;
+	const int opterr = ::opterr;
+	::optind = 0;
+	const bool parsed = m_opts->parse(argv.size() - 1, &argv[0]);
+	::optind = optind;
+	::opterr = opterr;
+	if (!parsed)
+		return false;
+	return load();
+}
+
+bool Engine::open(const Options& opts) {
+	m_opts.reset(new Options(opts));
+	return load();
+}
+
+bool Engine::load() {
+	m_creator.reset();
+	m_context.reset(new Context(*m_opts));
+	if (!m_context->init())
+		return false;
+	std::unique_ptr<MusicFileCreator> creator(new MusicFileCreator(*m_context));
+	if (!creator->init())
+		return false;
+	m_creator = std::move(creator);
+	m_layout = MusicFileCreator::layout_name(m_opts->layout());
+	return true;
+}
+
+bool Engine::generate(const Run& run, const std::string& output_dir, Results& results) {
+	if (output_dir.empty()) {
+		Tracer::_err("output dir is not set");
+		return false;
+	}
+	return generate(run, output_dir, nullptr, results);
+}
+
+bool Engine::generate(const Run& run, MusicFileSink& sink, Results& results) {
+	if (m_opts && !validate_sink_run())
+		return false;
+	return generate(run, "", &sink, results);
+}
+
+bool Engine::validate_sink_run() const {
+	// the files of a sink are the tagged templates in memory, the options of the files on disk don't apply
+	const char* opt = nullptr;
+	if (m_opts->synthesize_audio()) {
+		opt = "--synthesize-audio";
+	}
+	else if (m_opts->is_sparse_set()) {
+		opt = "--sparse";
+	}
+	else if (m_opts->preallocate()) {
+		opt = "--preallocate";
+	}
+	else if (m_opts->sync_params().policy != FileSyncer::Policy::NONE) {
+		opt = "--sync";
+	}
+	else if (m_opts->cache_policy() != MusicFileCreator::CachePolicy::KEEP) {
+		opt = "--cache-policy";
+	}
+	if (opt) {
+		Tracer::_err("a sink run can't be used with ", opt, ", generate to a dir instead");
+		return false;
+	}
+	return true;
+}
+
+bool Engine::generate(const Run& run, const std::string& output_dir, MusicFileSink* sink, Results& results) {
+	if (!m_creator) {
+		Tracer::_err("the engine is not open");
+		return false;
+	}
+	MusicFileCreator::Layout layout;
+	if (!MusicFileCreator::parse_layout(run.layout.empty() ? m_layout : run.layout, layout)) {
+		Tracer::_err("layout (", run.layout, ") must be one of artist, hashed, flat");
+		return false;
+	}
+	if (!m_opts->set_num_albums(run.num_albums)) {
+		Tracer::_err("num albums (", run.num_albums, ") must be > 0, <= ", Options::MAX_CDS);
+		return false;
+	}
+	if (!m_opts->set_output_dir(output_dir)) {
+		Tracer::_err("output dir ", output_dir, " is not a writable directory");
+		return false;
+	}
+	m_opts->set_seed(run.seed);
+	m_opts->set_layout(layout);
+
+	m_context->reset();
+	m_creator->set_sink(sink);
+	if (!m_creator->restart())
+		return false;
+	auto start = std::chrono::steady_clock::now();
+
+	const size_t num_threads = std::min(m_opts->num_threads(), run.num_albums);
+	MusicFilesGenerator generator(*m_context);
+	if (num_threads > 1 || m_opts->placement().is_set()) {
+		Launcher launcher(m_opts->placement());
+		launcher.launch(num_threads, generator, *m_creator);
+	}
+	else {
+		generator(*m_creator);
+	}
+	const bool finished = m_creator->finish();
+	m_creator->set_sink(nullptr);
+	m_context->mark_bad_files();
+	results = progress();
+	results.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return finished;
+}
+
+Engine::Results Engine::progress() const {
+	Results results;
+	if (m_context) {
+		results.created = m_context->create_success_count();
+		results.skipped = m_context->create_skipped_count();
+		results.failed = m_context->create_failed_count() + m_context->parse_fail_count();
+		results.bytes = m_context->bytes_written();
+	}
+	return results;
+}
+
+} /* namespace FMF */
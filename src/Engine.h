@@ -0,0 +1,138 @@
+/*
+ * Engine.h
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#ifndef ENGINE_H_
+#define ENGINE_H_
+
+#include "MusicFileSink.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace FMF {
+
+class Context;
+class MusicFileCreator;
+class Options;
+
+/**
+ * the api of libfmf, generates fake music files in process.
+ *
+ * open() loads the CDDB index or the synthetic albums and reads the templates once, then generate() runs any number
+ * of times on them, each run with its own albums, seed and output: a dir, or a MusicFileSink that gets the files
+ * tagged in memory. the runs of an engine are not concurrent, each run uses the threads of the options.
+ */
+class Engine {
+public:
+	/**
+	 * a generation run
+	 */
+	struct Run {
+		Run(size_t num_albums, uint32_t seed);
+
+		size_t num_albums;
+		uint32_t seed;
+		/// one of artist, hashed, flat (see --layout), the layout of the options if empty
+		std::string layout;
+	};
+
+	/**
+	 * counts of a run
+	 */
+	struct Results {
+		Results();
+
+		size_t created;
+		size_t skipped;
+		/// music files and CDDB files that failed
+		size_t failed;
+		uint64_t bytes;
+		double seconds;
+	};
+
+	Engine();
+	~Engine();
+
+	/**
+	 * open with the fmf command line options @e args, without the program name and the output (-o, --archive,
+	 * --mount), e.g. { "--synthetic", "-c", "4" } or { "-d", "/tmp/cddb" }
+	 *
+	 * the options are parsed with getopt, whose state is global: open() is not thread-safe, nor safe while another
+	 * thread of the process uses getopt. -h, --usage and --version output to stdout and fail the open.
+	 *
+	 * @return false if the options are invalid, the usage or the version was output, or loading the index or the
+	 * templates failed
+	 */
+	bool open(const std::vector<std::string>& args);
+
+	/**
+	 * open with options parsed by the fmf program, for option --daemon
+	 */
+	bool open(const Options& opts);
+
+	/**
+	 * generate the music files of @e run in the dir @e output_dir
+	 *
+	 * @return false if the run is invalid or finishing the files failed, @e results are set if it ran
+	 */
+	bool generate(const Run& run, const std::string& output_dir, Results& results);
+
+	/**
+	 * generate the music files of @e run tagged in memory and add them to @e sink, MusicFileSink::close() is
+	 * called at the end of the run
+	 *
+	 * @return false if the engine was opened with options of the files on disk: --synthesize-audio, --sparse,
+	 * --preallocate, --sync or --cache-policy
+	 */
+	bool generate(const Run& run, MusicFileSink& sink, Results& results);
+
+	/**
+	 * @return the counts of the current run so far without the seconds, may be called by other threads while
+	 * generate() runs
+	 */
+	Results progress() const;
+
+private:
+	Engine(const Engine&) = delete;
+	Engine& operator=(const Engine&) = delete;
+
+	bool load();
+
+	/**
+	 * @return false if an option of the files on disk is set, which a sink run would ignore
+	 */
+	bool validate_sink_run() const;
+
+	bool generate(const Run& run, const std::string& output_dir, MusicFileSink* sink, Results& results);
+
+	/// the options of the current run, which the context and the creator refer to
+	std::unique_ptr<Options> m_opts;
+	/// layout of the options, of the runs without a layout
+	std::string m_layout;
+	std::unique_ptr<Context> m_context;
+	std::unique_ptr<MusicFileCreator> m_creator;
+};
+
+} /* namespace FMF */
+#endif /* ENGINE_H_ */
@@ -20,13 +20,22 @@
  * Copyright 2014 GD <gd@iotide.com>
  */
 #include "File.h"
+#include "config.h"
 #include "Dir.h"
 
 #include <errno.h>
 #include <error.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
 
 namespace FMF {
 
@@ -43,6 +52,18 @@ std::string File::read_all() const {
 	return std::move(content.str());
 }
 
+bool File::read_all(std::string& content) const {
+	std::ifstream is(m_path, std::ios::binary | std::ios::in);
+	if (!is)
+		return false;
+	std::ostringstream os(std::ios::binary | std::ios::out);
+	os << is.rdbuf();
+	if (is.bad())
+		return false;
+	content = os.str();
+	return true;
+}
+
 bool File::exists() const {
 	struct stat st;
 	int err = ::stat(m_path.c_str(), &st);
@@ -54,6 +75,80 @@ bool File::exists() const {
 	return true;
 }
 
+/*static*/bool File::write_all(int fd, std::vector<iovec>& iov) {
+	size_t first = 0;
+	while (first < iov.size()) {
+		const int count = std::min<size_t>(iov.size() - first, IOV_MAX);
+		ssize_t n = ::writev(fd, &iov[first], count);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		// skip the written buffers and the written part of a partly written buffer
+		while (first < iov.size() && static_cast<size_t>(n) >= iov[first].iov_len) {
+			n -= iov[first].iov_len;
+			first++;
+		}
+		if (n > 0) {
+			iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + n;
+			iov[first].iov_len -= n;
+		}
+	}
+	return true;
+}
+
+/*static*/bool File::write_all(int fd, const char* data, size_t size) {
+	size_t done = 0;
+	while (done < size) {
+		ssize_t n = ::write(fd, data + done, size - done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		if (n == 0) {
+			errno = EIO;
+			return false;
+		}
+		done += n;
+	}
+	return true;
+}
+
+/*static*/bool File::pwrite_all(int fd, const char* data, size_t size, off_t offset) {
+	size_t done = 0;
+	while (done < size) {
+		ssize_t n = ::pwrite(fd, data + done, size - done, offset + done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		if (n == 0) {
+			errno = EIO;
+			return false;
+		}
+		done += n;
+	}
+	return true;
+}
+
+/*static*/bool File::preallocate(int fd, size_t size) {
+#ifdef HAVE_FALLOCATE
+	while (::fallocate(fd, 0, 0, size)) {
+		if (errno != EINTR)
+			return false;
+	}
+	return true;
+#else
+	(void) fd;
+	(void) size;
+	errno = EOPNOTSUPP;
+	return false;
+#endif
+}
+
 void File::split_path() {
 	auto npos = m_path.rfind(Dir::DIR_SEP, std::string::npos);
 	auto epos = m_path.rfind('.', std::string::npos);
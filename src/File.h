@@ -22,7 +22,9 @@
 #ifndef MUSICFILE_H_
 #define MUSICFILE_H_
 
+#include <sys/uio.h>
 #include <string>
+#include <vector>
 
 namespace FMF {
 
@@ -44,8 +46,43 @@ public:
 
 	std::string read_all() const;
 
+	/**
+	 * read the whole file into @e content
+	 *
+	 * @return false if the file could not be opened or read
+	 */
+	bool read_all(std::string& content) const;
+
 	bool exists() const;
 
+	/**
+	 * writev all of @e iov to @e fd, continuing after partial writes
+	 *
+	 * @return false if writing failed, errno is set
+	 */
+	static bool write_all(int fd, std::vector<iovec>& iov);
+
+	/**
+	 * write all @e size bytes of @e data to @e fd at its file offset, continuing after partial writes
+	 *
+	 * @return false if writing failed, errno is set
+	 */
+	static bool write_all(int fd, const char* data, size_t size);
+
+	/**
+	 * pwrite all @e size bytes of @e data to @e fd at @e offset, continuing after partial writes
+	 *
+	 * @return false if writing failed, errno is set
+	 */
+	static bool pwrite_all(int fd, const char* data, size_t size, off_t offset);
+
+	/**
+	 * allocate the disk space of the first @e size bytes of @e fd with fallocate(2), extending it to @e size
+	 *
+	 * @return false if failed or not supported by the file system, errno is set
+	 */
+	static bool preallocate(int fd, size_t size);
+
 private:
 	void split_path();
 
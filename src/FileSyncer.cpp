@@ -0,0 +1,232 @@
+/*
+ * FileSyncer.cpp
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#include "FileSyncer.h"
+#include "config.h"
+#include "Context.h"
+#include "Tracer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sstream>
+
+namespace FMF {
+
+static const char* s_policy_names[] = { "none", "album", "batch", "end" };
+
+static double seconds(uint64_t ns) {
+	return ns / 1e9;
+}
+
+//-----------------------------------------------------------------------------
+// FileSyncer::Params
+//-----------------------------------------------------------------------------
+FileSyncer::Params::Params() :
+		policy(Policy::NONE), batch_size(0) {
+}
+
+bool FileSyncer::Params::parse(const std::string& spec) {
+	auto pos = spec.find(':');
+	const std::string name = spec.substr(0, pos);
+	const size_t num_policies = sizeof(s_policy_names) / sizeof(s_policy_names[0]);
+	size_t i = 0;
+	while (i < num_policies && name != s_policy_names[i]) {
+		i++;
+	}
+	if (i == num_policies)
+		return false;
+	policy = static_cast<Policy>(i);
+	if (policy != Policy::BATCH)
+		return pos == std::string::npos;
+
+	const std::string value = (pos == std::string::npos) ? "" : spec.substr(pos + 1);
+	unsigned long n;
+	int end = 0;
+	if (1 != ::sscanf(value.c_str(), "%lu%n", &n, &end) || end != (int) value.size() || n == 0 || n > MAX_BATCH_SIZE)
+		return false;
+	batch_size = n;
+	return true;
+}
+
+std::ostream& operator<<(std::ostream& os, const FileSyncer::Params& params) {
+	os << s_policy_names[static_cast<size_t>(params.policy)];
+	if (params.policy == FileSyncer::Policy::BATCH) {
+		os << ":" << params.batch_size;
+	}
+	return os;
+}
+
+//-----------------------------------------------------------------------------
+// FileSyncer::Batch
+//-----------------------------------------------------------------------------
+FileSyncer::Batch::Batch(FileSyncer* syncer) :
+		m_syncer(syncer), m_paths() {
+}
+
+FileSyncer::Batch::~Batch() {
+	sync();
+}
+
+void FileSyncer::Batch::add(const std::string& path) {
+	if (!m_syncer || (m_syncer->m_params.policy == Policy::END && !m_syncer->m_drop_cache))
+		return;
+	int fd = m_syncer->open(path);
+	if (fd < 0)
+		return;
+	m_syncer->start_writeback(fd);
+	::close(fd);
+	m_paths.push_back(path);
+	if (m_syncer->m_params.policy == Policy::BATCH && m_paths.size() >= m_syncer->m_params.batch_size) {
+		sync();
+	}
+}
+
+void FileSyncer::Batch::end_album() {
+	// with Policy::NONE and Policy::END the batch holds files only when dropping the cache
+	if (m_syncer && m_syncer->m_params.policy != Policy::BATCH) {
+		sync();
+	}
+}
+
+void FileSyncer::Batch::sync() {
+	// the files are opened again one at a time, a batch of open files could exceed the open files limit
+	for (const std::string& path : m_paths) {
+		int fd = m_syncer->open(path);
+		if (fd >= 0) {
+			m_syncer->sync(fd);
+			::close(fd);
+		}
+	}
+	m_paths.clear();
+}
+
+//-----------------------------------------------------------------------------
+// FileSyncer
+//-----------------------------------------------------------------------------
+/*static*/const size_t FileSyncer::MAX_BATCH_SIZE;
+
+FileSyncer::FileSyncer(Context& ctx, const Params& params, const std::string& dir, bool drop_cache) :
+		m_context(ctx), m_params(params), m_dir(dir), m_drop_cache(drop_cache), m_writeback_ns(0), m_fdatasync_ns(0), m_syncfs_ns(
+				0), m_synced_files(0), m_failed_files(0), m_dropped_files(0) {
+}
+
+FileSyncer::~FileSyncer() {
+}
+
+int FileSyncer::open(const std::string& path) {
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		Tracer::_warn("failed to open ", path, " for syncing: ", ::strerror(errno));
+		m_failed_files++;
+	}
+	return fd;
+}
+
+void FileSyncer::start_writeback(int fd) {
+#ifdef HAVE_SYNC_FILE_RANGE
+	auto start = std::chrono::steady_clock::now();
+	// only starts the writeback of the dirty pages, does not wait for it
+	::sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+	add_time(m_writeback_ns, start);
+#else
+	(void) fd;
+#endif
+}
+
+void FileSyncer::wait_writeback(int fd) {
+	auto start = std::chrono::steady_clock::now();
+#ifdef HAVE_SYNC_FILE_RANGE
+	::sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#else
+	::fdatasync(fd);
+#endif
+	add_time(m_writeback_ns, start);
+}
+
+bool FileSyncer::sync(int fd) {
+	bool res = true;
+	if (m_params.policy == Policy::ALBUM || m_params.policy == Policy::BATCH) {
+		auto start = std::chrono::steady_clock::now();
+		res = ::fdatasync(fd) == 0;
+		add_time(m_fdatasync_ns, start);
+		if (res) {
+			m_synced_files++;
+		}
+		else {
+			Tracer::_warn("fdatasync failed: ", ::strerror(errno));
+			m_failed_files++;
+		}
+	}
+	else {
+		wait_writeback(fd);
+	}
+	if (res && m_drop_cache) {
+		::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		m_dropped_files++;
+	}
+	return res;
+}
+
+void FileSyncer::add_time(std::atomic<uint64_t>& ns, std::chrono::steady_clock::time_point start) {
+	auto time = std::chrono::steady_clock::now() - start;
+	ns += std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+	m_context.add_stage_time(Context::Stage::SYNC, time);
+}
+
+bool FileSyncer::finish() {
+	bool res = m_failed_files == 0;
+	if (m_params.policy == Policy::END) {
+		auto start = std::chrono::steady_clock::now();
+#ifdef HAVE_SYNCFS
+		int fd = ::open(m_dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (fd < 0 || ::syncfs(fd)) {
+			Tracer::_err("failed to sync the file system of ", m_dir, ": ", ::strerror(errno));
+			res = false;
+		}
+		if (fd >= 0) {
+			::close(fd);
+		}
+#else
+		::sync();
+#endif
+		add_time(m_syncfs_ns, start);
+	}
+
+	std::ostringstream policy;
+	policy << m_params;
+	char line[256];
+	::snprintf(line, sizeof(line), "Sync %s: writeback in %.3fs, fdatasync of %zu files in %.3fs, syncfs in %.3fs",
+			policy.str().c_str(), seconds(m_writeback_ns), m_synced_files.load(), seconds(m_fdatasync_ns),
+			seconds(m_syncfs_ns));
+	Tracer::cout(line);
+	if (m_drop_cache) {
+		Tracer::cout("Dropped ", m_dropped_files.load(), " files from the page cache");
+	}
+	if (m_failed_files) {
+		Tracer::_err("failed to sync ", m_failed_files, " files");
+	}
+	return res;
+}
+
+} /* namespace FMF */
@@ -0,0 +1,157 @@
+/*
+ * FileSyncer.h
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#ifndef FILESYNCER_H_
+#define FILESYNCER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace FMF {
+
+class Context;
+
+/**
+ * syncs the created music files to disk, set by option --sync, and drops them from the page cache with option
+ * --cache-policy.
+ *
+ * with Policy::ALBUM and Policy::BATCH the writeback of each file is started when it is created with
+ * sync_file_range(2), then the files are fdatasync'ed at the end of each album or each batch of files, so the dirty
+ * memory stays bounded. with Policy::END the file system of the output dir is synced once with syncfs(2) after the
+ * run. the time of each is added to Context::Stage::SYNC and reported by finish().
+ *
+ * when dropping the cache, the files are also kept with the other policies and their writeback is waited for at the
+ * end of each album, as only the clean pages are dropped by posix_fadvise(2).
+ */
+class FileSyncer {
+public:
+	enum class Policy {
+		NONE, ALBUM, BATCH, END
+	};
+
+	/**
+	 * set by option --sync=none|album|batch:<n>|end
+	 */
+	struct Params {
+		Params();
+
+		/**
+		 * @return false if @e spec is invalid
+		 */
+		bool parse(const std::string& spec);
+
+		Policy policy;
+		/// number of files synced together with Policy::BATCH
+		size_t batch_size;
+	};
+
+	/**
+	 * the files created by a thread since its last sync
+	 */
+	class Batch {
+	public:
+		/**
+		 * @param syncer	if null the files are not synced
+		 */
+		Batch(FileSyncer* syncer);
+		~Batch();
+
+		/**
+		 * start the writeback of the created file @e path and sync the batch if full
+		 */
+		void add(const std::string& path);
+
+		/**
+		 * sync the batch with Policy::ALBUM, or drop it from the page cache with other policies than Policy::BATCH
+		 */
+		void end_album();
+
+		void sync();
+
+	private:
+		Batch(const Batch&) = delete;
+		Batch& operator=(const Batch&) = delete;
+
+		FileSyncer* m_syncer;
+		/// the files are not kept open between add() and sync()
+		std::vector<std::string> m_paths;
+	};
+
+	/// max Params::batch_size
+	static const size_t MAX_BATCH_SIZE = 1024;
+
+	/**
+	 * @param drop_cache	drop the synced files from the page cache
+	 */
+	FileSyncer(Context& ctx, const Params& params, const std::string& dir, bool drop_cache);
+	~FileSyncer();
+
+	/**
+	 * sync the file system of the dir with Policy::END and report the sync times
+	 *
+	 * @return false if syncing failed
+	 */
+	bool finish();
+
+	friend std::ostream& operator<<(std::ostream& os, const Params& params);
+
+private:
+	/**
+	 * open the created file @e path for syncing
+	 *
+	 * @return the fd, or -1 if opening failed
+	 */
+	int open(const std::string& path);
+
+	void start_writeback(int fd);
+
+	/**
+	 * fdatasync @e fd with Policy::ALBUM and Policy::BATCH, wait for its writeback otherwise, then drop it from the
+	 * page cache if set
+	 */
+	bool sync(int fd);
+
+	void wait_writeback(int fd);
+
+	/**
+	 * add the time since @e start to @e ns and to Context::Stage::SYNC
+	 */
+	void add_time(std::atomic<uint64_t>& ns, std::chrono::steady_clock::time_point start);
+
+	Context& m_context;
+	const Params m_params;
+	const std::string m_dir;
+	const bool m_drop_cache;
+	std::atomic<uint64_t> m_writeback_ns;
+	std::atomic<uint64_t> m_fdatasync_ns;
+	std::atomic<uint64_t> m_syncfs_ns;
+	std::atomic<size_t> m_synced_files;
+	std::atomic<size_t> m_failed_files;
+	std::atomic<size_t> m_dropped_files;
+};
+
+} /* namespace FMF */
+#endif /* FILESYNCER_H_ */
@@ -24,22 +24,97 @@
 #include "MusicFilesGenerator.h"
 #include "Tracer.h"
 
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
 #include <exception>
+#include <fstream>
+#include <sstream>
 #include <thread>
 #include <vector>
 
 namespace FMF {
 
-Launcher::Launcher() {
+static const char* NUMA_NODES_DIR = "/sys/devices/system/node";
+
+/// numa node and index of the thread, set by Launcher::launch()
+static thread_local size_t t_node = 0;
+static thread_local size_t t_index = 0;
+
+//-----------------------------------------------------------------------------
+// Launcher::Placement
+//-----------------------------------------------------------------------------
+Launcher::Placement::Placement() :
+		pin_cpus(false), cpus(), numa(false) {
+}
+
+/*static*/bool Launcher::Placement::parse_cpus(const std::string& spec, std::vector<int>& cpus) {
+	std::istringstream is(spec);
+	std::string item;
+	cpus.clear();
+	while (std::getline(is, item, ',')) {
+		int first, last, end = 0;
+		if (2 != ::sscanf(item.c_str(), "%d-%d%n", &first, &last, &end) || end != (int) item.size()) {
+			end = 0;
+			if (1 != ::sscanf(item.c_str(), "%d%n", &first, &end) || end != (int) item.size())
+				return false;
+			last = first;
+		}
+		if (first < 0 || first > last || last >= CPU_SETSIZE)
+			return false;
+		for (int cpu = first; cpu <= last; cpu++) {
+			cpus.push_back(cpu);
+		}
+	}
+	return !cpus.empty();
+}
+
+//-----------------------------------------------------------------------------
+// Launcher
+//-----------------------------------------------------------------------------
+Launcher::Launcher() :
+		m_placement() {
+}
+
+Launcher::Launcher(const Placement& placement) :
+		m_placement(placement) {
 }
 
 void Launcher::launch(size_t num_threads, MusicFilesGenerator& generator, MusicFileCreator& creator) {
+	launch(num_threads, [&generator, &creator]() {generator(creator);});
+}
+
+void Launcher::launch(size_t num_threads, const std::function<void()>& fn) {
 	std::vector<std::thread> threads(num_threads);
+	std::vector<std::vector<int>> cpus(num_threads);
+	std::vector<size_t> nodes(num_threads);
+	if (m_placement.is_set()) {
+		place_threads(num_threads, cpus, nodes);
+	}
 
 	try {
-		for (std::thread& t: threads) {
-			t = std::thread(std::ref(generator), std::ref(creator));
+		for (size_t i = 0; i < num_threads; i++) {
+			// the thread is placed before it allocates anything
+			threads[i] = std::thread([&fn, &cpus, &nodes, i]() {
+				t_index = i;
+				if (!cpus[i].empty()) {
+					cpu_set_t set;
+					CPU_ZERO(&set);
+					for (int cpu : cpus[i]) {
+						CPU_SET(cpu, &set);
+					}
+					int err = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+					if (err) {
+						Tracer::_warn("failed to set the cpu affinity of thread ", i, ": ", ::strerror(err));
+					}
+					t_node = nodes[i];
+				}
+				fn();
+			});
 		}
 	}
 	catch (std::exception& e) {
@@ -53,4 +128,95 @@ void Launcher::launch(size_t num_threads, MusicFilesGenerator& generator, MusicF
 	}
 }
 
+void Launcher::place_threads(size_t num_threads, std::vector<std::vector<int>>& cpus, std::vector<size_t>& nodes) const {
+	std::vector<int> allowed = m_placement.cpus;
+	if (allowed.empty()) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		::sched_getaffinity(0, sizeof(set), &set);
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+			if (CPU_ISSET(cpu, &set)) {
+				allowed.push_back(cpu);
+			}
+		}
+	}
+
+	// the allowed cpus of each node, by node number
+	std::vector<std::vector<int>> groups(1, allowed);
+	std::vector<size_t> group_nodes(1, 0);
+	if (m_placement.numa) {
+		groups.clear();
+		group_nodes.clear();
+		auto node_cpus = numa_nodes();
+		for (size_t node = 0; node < node_cpus.size(); node++) {
+			std::vector<int> group;
+			for (int cpu : node_cpus[node]) {
+				if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) {
+					group.push_back(cpu);
+				}
+			}
+			if (!group.empty()) {
+				groups.push_back(group);
+				group_nodes.push_back(node);
+			}
+		}
+		if (groups.empty()) {
+			Tracer::_warn("no numa node has an allowed cpu, threads are not placed");
+			return;
+		}
+	}
+
+	for (size_t i = 0; i < num_threads; i++) {
+		const std::vector<int>& group = groups[i % groups.size()];
+		nodes[i] = group_nodes[i % groups.size()];
+		if (m_placement.pin_cpus) {
+			cpus[i].assign(1, group[(i / groups.size()) % group.size()]);
+		}
+		else {
+			cpus[i] = group;
+		}
+		Tracer::_debug("thread ", i, " on node ", nodes[i], " cpus ", cpus[i].size(), " from ", cpus[i][0]);
+	}
+}
+
+/*static*/std::vector<std::vector<int>> Launcher::numa_nodes() {
+	std::vector<std::vector<int>> nodes;
+	DIR* dir = ::opendir(NUMA_NODES_DIR);
+	if (dir) {
+		while (struct dirent* entry = ::readdir(dir)) {
+			unsigned node;
+			int end = 0;
+			if (1 != ::sscanf(entry->d_name, "node%u%n", &node, &end) || entry->d_name[end] || node >= CPU_SETSIZE)
+				continue;
+			std::ifstream is(std::string(NUMA_NODES_DIR) + "/" + entry->d_name + "/cpulist");
+			std::string cpulist;
+			std::vector<int> cpus;
+			// nodes of memory only have an empty cpu list
+			if (std::getline(is, cpulist) && !cpulist.empty() && !Placement::parse_cpus(cpulist, cpus))
+				continue;
+			if (nodes.size() <= node) {
+				nodes.resize(node + 1);
+			}
+			nodes[node] = cpus;
+		}
+		::closedir(dir);
+	}
+	if (nodes.empty()) {
+		std::vector<int> cpus;
+		for (unsigned cpu = 0; cpu < std::thread::hardware_concurrency(); cpu++) {
+			cpus.push_back(cpu);
+		}
+		nodes.push_back(cpus);
+	}
+	return nodes;
+}
+
+/*static*/size_t Launcher::thread_node() {
+	return t_node;
+}
+
+/*static*/size_t Launcher::thread_index() {
+	return t_index;
+}
+
 } /* namespace FMF */
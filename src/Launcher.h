@@ -23,6 +23,9 @@
 #define LAUNCHER_H_
 
 #include <stddef.h>
+#include <functional>
+#include <string>
+#include <vector>
 
 namespace FMF {
 
@@ -31,11 +34,69 @@ class MusicFilesGenerator;
 
 /**
  * launch threads to run MusicFilesGenerator with MusicFileCreator
+ *
+ * with a Placement each thread sets its cpu affinity before running, so the memory it touches first is allocated on
+ * its numa node. the numa nodes are read from sysfs.
  */
 class Launcher {
 public:
+	/**
+	 * placement of the threads, set by options --cpu-affinity and --numa
+	 */
+	struct Placement {
+		Placement();
+
+		bool is_set() const {
+			return pin_cpus || numa;
+		}
+
+		/**
+		 * parse a cpu list: <cpu>|<first>-<last>[,...] e.g. 0-7,16-23
+		 *
+		 * @return false if @e spec is invalid
+		 */
+		static bool parse_cpus(const std::string& spec, std::vector<int>& cpus);
+
+		/// pin each thread to a single cpu, round robin
+		bool pin_cpus;
+		/// the cpus the threads run on, all the cpus the process may run on if empty
+		std::vector<int> cpus;
+		/// place the threads round robin on the numa nodes, each on the cpus of its node
+		bool numa;
+	};
+
 	Launcher();
+	Launcher(const Placement& placement);
+
 	void launch(size_t num_threads, MusicFilesGenerator& generator, MusicFileCreator& creator);
+
+	/**
+	 * run @e fn in @e num_threads threads and wait for all of them to finish
+	 */
+	void launch(size_t num_threads, const std::function<void()>& fn);
+
+	/**
+	 * @return the cpus of each numa node by node number, one node of all the cpus if there is no numa information
+	 */
+	static std::vector<std::vector<int>> numa_nodes();
+
+	/**
+	 * @return the numa node the calling thread was placed on by launch(), 0 if not placed on a node
+	 */
+	static size_t thread_node();
+
+	/**
+	 * @return the index of the calling thread from 0 to num_threads - 1 of launch(), 0 if not launched
+	 */
+	static size_t thread_index();
+
+private:
+	/**
+	 * set the cpus and the node of thread @e i of @e num_threads
+	 */
+	void place_threads(size_t num_threads, std::vector<std::vector<int>>& cpus, std::vector<size_t>& nodes) const;
+
+	const Placement m_placement;
 };
 
 } /* namespace FMF */
@@ -0,0 +1,212 @@
+/*
+ * Manifest.cpp
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#include "Manifest.h"
+#include "File.h"
+#include "Tracer.h"
+#include "TrackInfo.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace FMF {
+
+static const char* s_format_names[] = { "jsonl", "binary" };
+
+static const char BINARY_MAGIC[] = "FMFMNFST";
+static const uint32_t BINARY_VERSION = 1;
+
+static void put_le(std::string& out, uint64_t value, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		out += static_cast<char>(value & 0xFF);
+		value >>= 8;
+	}
+}
+
+static void put_string(std::string& out, const std::string& str) {
+	put_le(out, str.size(), 4);
+	out += str;
+}
+
+//-----------------------------------------------------------------------------
+// Manifest::Writer
+//-----------------------------------------------------------------------------
+Manifest::Writer::Writer(Manifest* manifest) :
+		m_manifest(manifest), m_buffer(), m_num_records(0) {
+	if (m_manifest) {
+		m_buffer.reserve(BUFFER_SIZE);
+	}
+}
+
+Manifest::Writer::~Writer() {
+	flush();
+}
+
+void Manifest::Writer::add(const std::string& path, uint64_t size, const TrackInfo& ti) {
+	if (!m_manifest)
+		return;
+	// the comment tag is set to the db file
+	if (m_manifest->m_format == Format::JSONL) {
+		char numbers[64];
+		m_buffer += "{\"path\":" + json_string(path);
+		::snprintf(numbers, sizeof(numbers), ",\"size\":%llu", static_cast<unsigned long long>(size));
+		m_buffer += numbers;
+		m_buffer += ",\"album\":" + json_string(ti.album());
+		m_buffer += ",\"artist\":" + json_string(ti.artist());
+		m_buffer += ",\"title\":" + json_string(ti.title());
+		m_buffer += ",\"genre\":" + json_string(ti.genre());
+		m_buffer += ",\"comment\":" + json_string(ti.db_file());
+		::snprintf(numbers, sizeof(numbers), ",\"year\":%zu,\"track\":%zu}\n", ti.year(), ti.track_num());
+		m_buffer += numbers;
+	}
+	else {
+		const size_t start = m_buffer.size();
+		put_le(m_buffer, 0, 4);
+		put_le(m_buffer, size, 8);
+		put_le(m_buffer, ti.year(), 4);
+		put_le(m_buffer, ti.track_num(), 4);
+		put_string(m_buffer, path);
+		put_string(m_buffer, ti.album());
+		put_string(m_buffer, ti.artist());
+		put_string(m_buffer, ti.title());
+		put_string(m_buffer, ti.genre());
+		put_string(m_buffer, ti.db_file());
+		std::string length;
+		put_le(length, m_buffer.size() - start - 4, 4);
+		m_buffer.replace(start, 4, length);
+	}
+	m_num_records++;
+	if (m_buffer.size() >= BUFFER_SIZE) {
+		flush();
+	}
+}
+
+void Manifest::Writer::flush() {
+	if (m_num_records) {
+		m_manifest->write(m_buffer, m_num_records);
+		m_buffer.clear();
+		m_num_records = 0;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Manifest
+//-----------------------------------------------------------------------------
+/*static*/bool Manifest::parse_format(const std::string& name, Format& format) {
+	for (size_t i = 0; i < sizeof(s_format_names) / sizeof(s_format_names[0]); i++) {
+		if (name == s_format_names[i]) {
+			format = static_cast<Format>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+/*static*/const char* Manifest::format_name(Format format) {
+	return s_format_names[static_cast<size_t>(format)];
+}
+
+/*static*/std::string Manifest::json_string(const std::string& str) {
+	std::string json = "\"";
+	for (char c : str) {
+		if (c == '"' || c == '\\') {
+			json += '\\';
+			json += c;
+		}
+		else if (static_cast<unsigned char>(c) < 0x20) {
+			char esc[8];
+			::snprintf(esc, sizeof(esc), "\\u%04x", c);
+			json += esc;
+		}
+		else {
+			json += c;
+		}
+	}
+	return json + '"';
+}
+
+Manifest::Manifest(const std::string& path, Format format) :
+		m_path(path), m_format(format), m_fd(-1), m_lock(), m_num_records(0), m_error(0) {
+}
+
+Manifest::~Manifest() {
+	if (m_fd >= 0) {
+		::close(m_fd);
+	}
+}
+
+bool Manifest::open() {
+	m_fd = ::open(m_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (m_fd < 0) {
+		Tracer::_err("failed to create manifest ", m_path, ": ", ::strerror(errno));
+		return false;
+	}
+	if (m_format == Format::BINARY) {
+		std::string header(BINARY_MAGIC, sizeof(BINARY_MAGIC) - 1);
+		put_le(header, BINARY_VERSION, 4);
+		put_le(header, 0, 4);
+		put_le(header, 0, 8);
+		if (!File::write_all(m_fd, header.data(), header.size())) {
+			Tracer::_err("failed to write manifest ", m_path, ": ", ::strerror(errno));
+			return false;
+		}
+	}
+	return true;
+}
+
+void Manifest::write(const std::string& data, size_t num_records) {
+	std::lock_guard < std::mutex > locker(m_lock);
+	if (m_error)
+		return;
+	if (File::write_all(m_fd, data.data(), data.size())) {
+		m_num_records += num_records;
+	}
+	else {
+		m_error = errno;
+	}
+}
+
+bool Manifest::close() {
+	if (m_fd < 0)
+		return false;
+	if (!m_error && m_format == Format::BINARY) {
+		std::string count;
+		put_le(count, m_num_records, 8);
+		if (!File::pwrite_all(m_fd, count.data(), count.size(), BINARY_COUNT_OFFSET)) {
+			m_error = errno;
+		}
+	}
+	if (::close(m_fd) && !m_error) {
+		m_error = errno;
+	}
+	m_fd = -1;
+	if (m_error) {
+		Tracer::_err("failed to write manifest ", m_path, ": ", ::strerror(m_error));
+		return false;
+	}
+	Tracer::_info("wrote ", m_num_records, " records to manifest ", m_path);
+	return true;
+}
+
+} /* namespace FMF */
@@ -0,0 +1,125 @@
+/*
+ * Manifest.h
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#ifndef MANIFEST_H_
+#define MANIFEST_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include <string>
+
+namespace FMF {
+
+class TrackInfo;
+
+/**
+ * list of the created music files with their size and tags, set by option --manifest.
+ *
+ * each generator thread buffers its records in a Writer, full buffers are appended to the manifest file in one write,
+ * so the records of the threads are not interleaved and the manifest costs one write per BUFFER_SIZE bytes.
+ *
+ * formats:
+ * jsonl: a json object per line: path, size, album, artist, title, genre, comment, year, track
+ * binary: a header of the magic "FMFMNFST", version:u32, reserved:u32, number of records:u64, then records of
+ * length:u32 (of the rest of the record), size:u64, year:u32, track:u32, then the strings path, album, artist, title,
+ * genre, comment as length:u32 and utf-8 bytes. all integers are little endian.
+ */
+class Manifest {
+public:
+	enum class Format {
+		JSONL, BINARY
+	};
+
+	/**
+	 * buffers the records of a thread, flushed when full and when destroyed
+	 */
+	class Writer {
+	public:
+		/**
+		 * @param manifest	if null the records are discarded
+		 */
+		Writer(Manifest* manifest);
+		~Writer();
+
+		/**
+		 * add the record of the music file @e path, relative to the output root, of @e size bytes tagged with @e ti
+		 */
+		void add(const std::string& path, uint64_t size, const TrackInfo& ti);
+
+		void flush();
+
+	private:
+		Writer(const Writer&) = delete;
+		Writer& operator=(const Writer&) = delete;
+
+		Manifest* m_manifest;
+		std::string m_buffer;
+		size_t m_num_records;
+	};
+
+	/**
+	 * @return false if @e name is not one of jsonl, binary
+	 */
+	static bool parse_format(const std::string& name, Format& format);
+
+	static const char* format_name(Format format);
+
+	/**
+	 * @return @e str as a quoted json string
+	 */
+	static std::string json_string(const std::string& str);
+
+	Manifest(const std::string& path, Format format);
+	~Manifest();
+
+	/**
+	 * create the manifest file
+	 */
+	bool open();
+
+	/**
+	 * complete the header and close the manifest, after all the writers were flushed
+	 *
+	 * @return false if writing the manifest failed
+	 */
+	bool close();
+
+private:
+	/**
+	 * append @e data of @e num_records records
+	 */
+	void write(const std::string& data, size_t num_records);
+
+	static const size_t BUFFER_SIZE = 256 << 10;
+	/// offset of the number of records in the binary header
+	static const size_t BINARY_COUNT_OFFSET = 16;
+
+	const std::string m_path;
+	const Format m_format;
+	int m_fd;
+	std::mutex m_lock;
+	uint64_t m_num_records;
+	int m_error;
+};
+
+} /* namespace FMF */
+#endif /* MANIFEST_H_ */
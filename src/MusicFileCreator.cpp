@@ -20,48 +20,348 @@
  * Copyright 2014 GD <gd@iotide.com>
  */
 #include "MusicFileCreator.h"
+#include "config.h"
 #include "Context.h"
 #include "Dir.h"
+#include "Launcher.h"
 #include "Options.h"
 #include "Tracer.h"
 #include "TrackInfo.h"
+#include "VirtualLibrary.h"
 
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <taglib/flacfile.h>
 #include <taglib/fileref.h>
+#include <taglib/id3v2framefactory.h>
+#include <taglib/mpegfile.h>
 #include <taglib/tag.h>
+#include <taglib/tbytevector.h>
+#include <taglib/tbytevectorstream.h>
 #include <taglib/tstring.h>
 #include <algorithm>
+#include <chrono>
 #include <climits>
 #include <cmath>
 #include <cstdbool>
 #include <fstream>
+#include <random>
+#include <unistd.h>
 
 namespace FMF {
 
+static const char* s_copy_strategy_names[] = { "stream", "memory", "copy-range" };
+
+/*static*/bool MusicFileCreator::parse_copy_strategy(const std::string& name, CopyStrategy& strategy) {
+	for (size_t i = 0; i < sizeof(s_copy_strategy_names) / sizeof(s_copy_strategy_names[0]); i++) {
+		if (name == s_copy_strategy_names[i]) {
+			strategy = static_cast<CopyStrategy>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+/*static*/const char* MusicFileCreator::copy_strategy_name(CopyStrategy strategy) {
+	return s_copy_strategy_names[static_cast<size_t>(strategy)];
+}
+
+static const char* s_layout_names[] = { "artist", "hashed", "flat" };
+
+/*static*/bool MusicFileCreator::parse_layout(const std::string& name, Layout& layout) {
+	for (size_t i = 0; i < sizeof(s_layout_names) / sizeof(s_layout_names[0]); i++) {
+		if (name == s_layout_names[i]) {
+			layout = static_cast<Layout>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+/*static*/const char* MusicFileCreator::layout_name(Layout layout) {
+	return s_layout_names[static_cast<size_t>(layout)];
+}
+
+static const char* s_cache_policy_names[] = { "keep", "drop", "direct" };
+
+/*static*/bool MusicFileCreator::parse_cache_policy(const std::string& name, CachePolicy& policy) {
+	for (size_t i = 0; i < sizeof(s_cache_policy_names) / sizeof(s_cache_policy_names[0]); i++) {
+		if (name == s_cache_policy_names[i]) {
+			policy = static_cast<CachePolicy>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+/*static*/const char* MusicFileCreator::cache_policy_name(CachePolicy policy) {
+	return s_cache_policy_names[static_cast<size_t>(policy)];
+}
+
+static const char* s_dry_run_names[] = { "none", "parse", "tag" };
+
+/*static*/bool MusicFileCreator::parse_dry_run(const std::string& name, DryRun& dry_run) {
+	// none is the default, not an option value
+	for (size_t i = 1; i < sizeof(s_dry_run_names) / sizeof(s_dry_run_names[0]); i++) {
+		if (name == s_dry_run_names[i]) {
+			dry_run = static_cast<DryRun>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+/*static*/const char* MusicFileCreator::dry_run_name(DryRun dry_run) {
+	return s_dry_run_names[static_cast<size_t>(dry_run)];
+}
+
+/**
+ * FNV-1a hash, stable across platforms unlike std::hash
+ */
+static uint32_t fnv1a(const std::string& str, uint32_t hash = 2166136261U) {
+	for (unsigned char c : str) {
+		hash = (hash ^ c) * 16777619U;
+	}
+	return hash;
+}
+
+//-----------------------------------------------------------------------------
+// MusicFileCreator::Template
+//-----------------------------------------------------------------------------
+MusicFileCreator::Template::Template(const std::string& path) :
+		file(path), format(Format::OTHER), data(), fd(-1), direct_data(nullptr) {
+	std::string ext = file.extension();
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	if (ext == "mp3") {
+		format = Format::MP3;
+	}
+	else if (ext == "flac") {
+		format = Format::FLAC;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// MusicFileCreator::Session
+//-----------------------------------------------------------------------------
+MusicFileCreator::Session::Session(MusicFileCreator& creator) :
+		dir_path(), manifest(creator.manifest()), sync(creator.m_syncer.get()), node(Launcher::thread_node()) {
+	creator.init_node(node);
+}
+
+//-----------------------------------------------------------------------------
+// MusicFileCreator
+//-----------------------------------------------------------------------------
 MusicFileCreator::MusicFileCreator(Context& ctx) :
-		m_context(ctx), m_opts(ctx.options()), m_template_file(m_opts.template_music_file()), m_template_data() {
+		m_context(ctx), m_opts(ctx.options()), m_taglib_lock(), m_templates(), m_template_table(), m_synthesizer(),
+				m_archive(), m_dry_run_sink(), m_sink(), m_sink_paths(), m_library(), m_manifest(), m_syncer(),
+				m_files_limiter(), m_bytes_limiter(), m_node_data(), m_node_once() {
 }
 
 MusicFileCreator::~MusicFileCreator() {
+	for (auto& templ : m_templates) {
+		if (templ.fd >= 0) {
+			::close(templ.fd);
+		}
+		::free(templ.direct_data);
+	}
 }
 
 bool MusicFileCreator::init() {
-	return read_template_file();
+	for (auto& path : m_opts.template_music_files()) {
+		m_templates.emplace_back(path);
+		Template& templ = m_templates.back();
+		if (!read_template_file(templ))
+			return false;
+		if (m_opts.copy_strategy() == CopyStrategy::COPY_RANGE) {
+			templ.fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+			if (templ.fd < 0) {
+				Tracer::_err("failed to open template file ", path, ": ", ::strerror(errno));
+				return false;
+			}
+		}
+		if (m_opts.cache_policy() == CachePolicy::DIRECT) {
+			void* aligned;
+			if (::posix_memalign(&aligned, DIRECT_ALIGN, templ.data.size() + DIRECT_ALIGN)) {
+				Tracer::_err("failed to allocate the direct buffer of template file ", path);
+				return false;
+			}
+			templ.direct_data = static_cast<char*>(aligned);
+			std::copy(templ.data.begin(), templ.data.end(), templ.direct_data);
+		}
+	}
+	std::vector<double> weights = m_opts.template_weights();
+	if (weights.size() != m_templates.size()) {
+		weights.assign(m_templates.size(), 1);
+	}
+	if (!m_template_table.init(weights)) {
+		Tracer::_err("no template music file to pick");
+		return false;
+	}
+	if (m_opts.is_manifest_set()) {
+		m_manifest.reset(new Manifest(m_opts.manifest_file(), m_opts.manifest_format()));
+		if (!m_manifest->open())
+			return false;
+	}
+	if (m_opts.is_archive_set()) {
+		m_archive.reset(new ArchiveWriter(m_opts.archive_file()));
+		if (!m_archive->open())
+			return false;
+		m_sink = m_archive.get();
+	}
+	if (m_opts.dry_run() == DryRun::TAG) {
+		m_dry_run_sink.reset(new NullSink());
+		m_sink = m_dry_run_sink.get();
+	}
+	if (m_opts.is_mount_set()) {
+		m_library.reset(new VirtualLibrary(*this));
+	}
+	if (m_opts.placement().numa) {
+		const size_t num_nodes = Launcher::numa_nodes().size();
+		if (num_nodes > 1) {
+			m_node_data.resize(num_nodes);
+			m_node_once.reset(new std::once_flag[num_nodes]);
+		}
+	}
+	return restart();
+}
+
+bool MusicFileCreator::restart() {
+	// the files of --dry-run=tag are discarded, a track picked again is tagged again like a new file
+	if (!m_sink || m_sink == m_dry_run_sink.get()) {
+		m_sink_paths.reset();
+	}
+	else if (m_sink_paths) {
+		m_sink_paths->clear();
+	}
+	else {
+		m_sink_paths.reset(new PathFilter());
+	}
+	const bool drop_cache = m_opts.cache_policy() != CachePolicy::KEEP;
+	m_syncer.reset();
+	if (!m_sink && (m_opts.sync_params().policy != FileSyncer::Policy::NONE || drop_cache)) {
+		m_syncer.reset(new FileSyncer(m_context, m_opts.sync_params(), m_opts.output_dir(), drop_cache));
+	}
+	m_files_limiter.reset();
+	if (m_opts.max_files_per_sec() > 0) {
+		m_files_limiter.reset(new RateLimiter(m_opts.max_files_per_sec()));
+	}
+	m_bytes_limiter.reset();
+	if (m_opts.max_mbps() > 0) {
+		m_bytes_limiter.reset(new RateLimiter(m_opts.max_mbps() * 1e6));
+	}
+	return true;
+}
+
+bool MusicFileCreator::finish() {
+	bool res = !m_sink || m_sink->close();
+	if (m_manifest && !m_manifest->close()) {
+		res = false;
+	}
+	if (m_syncer && !m_syncer->finish()) {
+		res = false;
+	}
+	if (m_files_limiter || m_bytes_limiter) {
+		report_rates();
+	}
+	return res;
+}
+
+void MusicFileCreator::init_node(size_t node) {
+	if (node >= m_node_data.size())
+		return;
+	std::call_once(m_node_once[node], [this, node]() {
+		for (auto& templ : m_templates) {
+			m_node_data[node].push_back(templ.data);
+		}
+		Tracer::_debug("copied the template data to numa node ", node);
+	});
+}
+
+const std::vector<char>& MusicFileCreator::template_data(const Template& templ, const Session& session) const {
+	if (session.node < m_node_data.size())
+		return m_node_data[session.node][&templ - &m_templates[0]];
+	return templ.data;
+}
+
+void MusicFileCreator::throttle(uint64_t size) {
+	if (m_files_limiter) {
+		m_files_limiter->acquire(1);
+	}
+	if (m_bytes_limiter) {
+		m_bytes_limiter->acquire(size);
+	}
+}
+
+void MusicFileCreator::report_rates() const {
+	char line[256];
+	int len = ::snprintf(line, sizeof(line), "Rate:");
+	std::chrono::nanoseconds wait_time(0);
+	if (m_files_limiter) {
+		len += ::snprintf(line + len, sizeof(line) - len, " %.2f files/s of max %g,", m_files_limiter->achieved_rate(),
+				m_files_limiter->rate());
+		wait_time += m_files_limiter->wait_time();
+	}
+	if (m_bytes_limiter) {
+		len += ::snprintf(line + len, sizeof(line) - len, " %.2f MB/s of max %g,", m_bytes_limiter->achieved_rate() / 1e6,
+				m_bytes_limiter->rate() / 1e6);
+		wait_time += m_bytes_limiter->wait_time();
+	}
+	::snprintf(line + len, sizeof(line) - len, " throttled for %.3fs", std::chrono::duration<double>(wait_time).count());
+	Tracer::cout(line);
+}
+
+uint32_t MusicFileCreator::track_seed(const TrackInfo& ti) const {
+	return fnv1a(ti.db_file(), m_opts.seed()) ^ (ti.track_num() * 0x9E3779B9U);
+}
+
+const MusicFileCreator::Template& MusicFileCreator::pick_template(const TrackInfo& ti) const {
+	if (m_templates.size() == 1) {
+		return m_templates[0];
+	}
+	std::minstd_rand rand(track_seed(ti));
+	return m_templates[m_template_table(rand)];
 }
 
-bool MusicFileCreator::create_music_file(const TrackInfo& ti, std::string& dir_path) {
+bool MusicFileCreator::create_music_file(const TrackInfo& ti, Session& session) {
 	if (!ti.validate()) {
 		Tracer::_err("invalid track info: ", ti);
 		m_context.on_create_failed();
 		return false;
 	}
 
-	if (!make_dir_path(ti, dir_path)) {
+	if (m_opts.dry_run() == DryRun::PARSE) {
+		// counted as the music file the track would be, of the size of its template
+		m_context.on_create_success();
+		throttle(pick_template(ti).data.size());
+		return true;
+	}
+	if (m_sink) {
+		return sink_music_file(ti, session);
+	}
+	if (m_library) {
+		return add_to_library(ti);
+	}
+
+	bool dir_created;
+	{
+		Context::StageTimer timer(m_context, Context::Stage::MKDIR);
+		dir_created = make_dir_path(ti, session.dir_path);
+	}
+	if (!dir_created) {
 		m_context.on_create_failed();
 		return false;
 	}
 
-	auto out_path = m_opts.output_dir() + Dir::DIR_SEP + dir_path + Dir::DIR_SEP + make_file_name(ti);
+	const Template& templ = pick_template(ti);
+	const std::string& dir_path = session.dir_path;
+	auto file_path = dir_path.empty() ? make_file_name(ti, templ) : dir_path + Dir::DIR_SEP + make_file_name(ti, templ);
+	auto out_path = m_opts.output_dir() + Dir::DIR_SEP + file_path;
 	File fout(out_path);
 	if (fout.exists()) {
 		Tracer::_info("skipping existing file: ", out_path);
@@ -69,26 +369,174 @@ bool MusicFileCreator::create_music_file(const TrackInfo& ti, std::string& dir_p
 		return true;
 	}
 
-	std::ofstream os(out_path, std::ios::binary | std::ios::out);
-	std::ifstream templ(m_opts.template_music_file(), std::ios::binary | std::ios::in);
-	os << templ.rdbuf();
-	os.close();
-	templ.close();
+	bool copied;
+	{
+		Context::StageTimer timer(m_context, Context::Stage::COPY);
+		copied = is_synthesized(templ, ti) ?
+				synthesize_audio(templ, ti, out_path) : copy_template(templ, template_data(templ, session), out_path);
+	}
+	if (!copied) {
+		m_context.on_create_failed();
+		return false;
+	}
+
+	bool tagged;
+	{
+		// the wait for the lock is part of the tag stage
+		Context::StageTimer timer(m_context, Context::Stage::TAG);
+		tagged = tag_music_file(templ, ti, out_path);
+	}
+	if (!tagged) {
+		m_context.on_create_failed();
+		return false;
+	}
+
+	if (m_opts.is_sparse_set()) {
+		Context::StageTimer timer(m_context, Context::Stage::COPY);
+		if (!make_sparse(ti, out_path)) {
+			m_context.on_create_failed();
+			return false;
+		}
+	}
+
+	struct stat sb;
+	if (::stat(out_path.c_str(), &sb) == 0) {
+		m_context.on_bytes_written(sb.st_size);
+		session.manifest.add(file_path, sb.st_size, ti);
+		throttle(sb.st_size);
+	}
+	session.sync.add(out_path);
+	m_context.on_create_success();
+	Tracer::_info("saved: ", out_path);
+	return true;
+}
+
+bool MusicFileCreator::sink_music_file(const TrackInfo& ti, Session& session) {
+	const Template& templ = pick_template(ti);
+	std::string path;
+	{
+		Context::StageTimer timer(m_context, Context::Stage::MKDIR);
+		path = make_file_path(ti, templ);
+		if (m_sink_paths && !m_sink_paths->insert(path)) {
+			Tracer::_info("skipping added file: ", path);
+			m_context.on_create_skipped();
+			return true;
+		}
+	}
+
+	std::string data;
+	bool tagged;
+	{
+		Context::StageTimer timer(m_context, Context::Stage::TAG);
+		tagged = tag_music_data(templ, ti, path, data);
+	}
+	if (!tagged) {
+		m_context.on_create_failed();
+		return false;
+	}
+
+	const size_t size = data.size();
+	bool added;
+	{
+		// the wait for room in the archive queue is part of the copy stage
+		Context::StageTimer timer(m_context, Context::Stage::COPY);
+		added = m_sink->add(path, std::move(data));
+	}
+	if (!added) {
+		Tracer::_err("failed to add ", path, m_archive ? " to archive " + m_archive->path() : " to the sink");
+		m_context.on_create_failed();
+		return false;
+	}
+	m_context.on_bytes_written(size);
+	session.manifest.add(path, size, ti);
+	m_context.on_create_success();
+	throttle(size);
+	Tracer::_info("added: ", path);
+	return true;
+}
+
+bool MusicFileCreator::add_to_library(const TrackInfo& ti) {
+	std::string path;
+	bool added;
+	{
+		Context::StageTimer timer(m_context, Context::Stage::MKDIR);
+		path = make_file_path(ti, pick_template(ti));
+		added = m_library->add(path, ti);
+	}
+	if (!added) {
+		Tracer::_info("skipping existing file: ", path);
+		m_context.on_create_skipped();
+		return true;
+	}
+	m_context.on_create_success();
+	Tracer::_info("added: ", path);
+	return true;
+}
+
+const std::vector<char>* MusicFileCreator::render_music_file(const TrackInfo& ti, std::string& data) {
+	const Template& templ = pick_template(ti);
+	if (!tag_music_data(templ, ti, make_file_name(ti, templ), data))
+		return nullptr;
+	return &templ.data;
+}
 
+bool MusicFileCreator::tag_music_file(const Template& templ, const TrackInfo& ti, const std::string& out_path) {
 	// taglib is not thread safe at this time Jan-2014
 	std::lock_guard < std::mutex > locker(m_taglib_lock);
 
-	TagLib::FileRef f(out_path.c_str());
+	// the audio properties are not read, only the tags are written
+	TagLib::FileRef f;
+	switch (templ.format) {
+	case Template::Format::MP3:
+		f = TagLib::FileRef(new TagLib::MPEG::File(out_path.c_str(), false));
+		break;
+	case Template::Format::FLAC:
+		f = TagLib::FileRef(new TagLib::FLAC::File(out_path.c_str(), false));
+		break;
+	case Template::Format::OTHER:
+		f = TagLib::FileRef(out_path.c_str(), false);
+		break;
+	}
+	return save_tags(f, templ, ti, out_path);
+}
+
+bool MusicFileCreator::tag_music_data(const Template& templ, const TrackInfo& ti, const std::string& name,
+		std::string& data) {
+	std::lock_guard < std::mutex > locker(m_taglib_lock);
+
+	TagLib::ByteVectorStream stream(TagLib::ByteVector(templ.data.data(), templ.data.size()));
+	{
+		// the file is closed before the stream
+		TagLib::FileRef f;
+		switch (templ.format) {
+		case Template::Format::MP3:
+			f = TagLib::FileRef(new TagLib::MPEG::File(&stream, TagLib::ID3v2::FrameFactory::instance(), false));
+			break;
+		case Template::Format::FLAC:
+			f = TagLib::FileRef(new TagLib::FLAC::File(&stream, TagLib::ID3v2::FrameFactory::instance(), false));
+			break;
+		case Template::Format::OTHER:
+			f = TagLib::FileRef(&stream, false);
+			break;
+		}
+		if (!save_tags(f, templ, ti, name))
+			return false;
+	}
+	const TagLib::ByteVector* tagged = stream.data();
+	data.assign(tagged->data(), tagged->size());
+	return true;
+}
+
+bool MusicFileCreator::save_tags(TagLib::FileRef& f, const Template& templ, const TrackInfo& ti,
+		const std::string& name) {
 	if (f.isNull()) {
-		Tracer::_err("failed to create music file from template ", m_opts.template_music_file());
-		m_context.on_create_failed();
+		Tracer::_err("failed to create music file from template ", templ.file.path());
 		return false;
 	}
 
 	auto tag = f.tag();
 	if (!tag) {
-		Tracer::_err("error in taglib with template file: ", m_opts.template_music_file());
-		m_context.on_create_failed();
+		Tracer::_err("error in taglib with template file: ", templ.file.path());
 		return false;
 	}
 
@@ -102,78 +550,259 @@ bool MusicFileCreator::create_music_file(const TrackInfo& ti, std::string& dir_p
 	tag->setComment(ti.db_file());
 
 	bool res = f.save();
-	if (res) {
-		m_context.on_create_success();
-		Tracer::_info("saved: ", out_path);
-	}
-	else {
-		m_context.on_create_failed();
-		Tracer::cerr("failed to save: ", res, " ", out_path);
+	if (!res) {
+		Tracer::cerr("failed to save: ", res, " ", name);
 	}
 	return res;
 }
 
-bool MusicFileCreator::read_template_file() {
-	std::ifstream template_file(m_opts.template_music_file(), std::ios::binary | std::ios::in);
+bool MusicFileCreator::make_sparse(const TrackInfo& ti, const std::string& out_path) {
+	const SyntheticAlbums::Range& sizes = m_opts.sparse_size();
+	std::minstd_rand rand(track_seed(ti) ^ 0x5BD1E995U);
+	const off_t size = std::uniform_int_distribution<size_t>(sizes.min, sizes.max)(rand);
+
+	int fd = ::open(out_path.c_str(), O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		Tracer::_err("failed to open ", out_path, ": ", ::strerror(errno));
+		return false;
+	}
+	struct stat sb;
+	if (::fstat(fd, &sb) || sb.st_size >= size) {
+		::close(fd);
+		return true;
+	}
+
+	// cut the tail off and write it back at the end of the file, leaving a hole in its place
+	std::vector<char> tail(std::min<off_t>(SPARSE_TAIL_SIZE, sb.st_size / 2));
+	bool res = ::pread(fd, tail.data(), tail.size(), sb.st_size - tail.size()) == (ssize_t) tail.size()
+			&& ::ftruncate(fd, sb.st_size - tail.size()) == 0 && ::ftruncate(fd, size) == 0
+			&& ::pwrite(fd, tail.data(), tail.size(), size - tail.size()) == (ssize_t) tail.size();
+	int err = res ? 0 : errno;
+	if (::close(fd) && !err) {
+		err = errno;
+	}
+	if (err) {
+		Tracer::_err("failed to make sparse file ", out_path, ": ", ::strerror(err));
+		return false;
+	}
+	return true;
+}
+
+bool MusicFileCreator::read_template_file(Template& templ) {
+	std::ifstream template_file(templ.file.path(), std::ios::binary | std::ios::in);
 	try {
 		template_file.exceptions(std::ios_base::failbit | std::ios_base::badbit);
 		auto size = template_file.seekg(0, std::ios::end).tellg();
 		template_file.seekg(0, std::ios::beg);
-		m_template_data.resize(size);
-		template_file.read(&m_template_data[0], size);
+		templ.data.resize(size);
+		template_file.read(&templ.data[0], size);
 		template_file.close();
 	}
 	catch (std::exception& e) {
-		Tracer::_err("failed to read template file ", m_opts.template_music_file());
+		Tracer::_err("failed to read template file ", templ.file.path());
+		return false;
+	}
+	return true;
+}
+
+bool MusicFileCreator::copy_template(const Template& templ, const std::vector<char>& data, const std::string& out_path) {
+	if (m_opts.copy_strategy() == CopyStrategy::STREAM) {
+		std::ofstream os(out_path, std::ios::binary | std::ios::out);
+		std::ifstream is(templ.file.path(), std::ios::binary | std::ios::in);
+		os << is.rdbuf();
+		os.close();
+		if (os.fail()) {
+			Tracer::_err("failed to copy template file to ", out_path);
+			::unlink(out_path.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	int fd = -1;
+	if (templ.direct_data) {
+		// fails with EINVAL on file systems without O_DIRECT, the file is then written through the page cache
+		fd = ::open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0666);
+	}
+	if (fd < 0) {
+		fd = ::open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	}
+	if (fd < 0) {
+		Tracer::_err("failed to create ", out_path, ": ", ::strerror(errno));
+		return false;
+	}
+	preallocate(fd, data.size(), out_path);
+	size_t done = (m_opts.copy_strategy() == CopyStrategy::COPY_RANGE) ? copy_template_range(templ, fd) : 0;
+	if (templ.direct_data) {
+		done = write_template_direct(templ, fd);
+	}
+	// at offset done, the file offset is past it if a direct write or a range copy stopped short
+	bool written = done >= data.size() || File::pwrite_all(fd, &data[done], data.size() - done, done);
+	int err = written ? 0 : errno;
+	if (::close(fd) && !err) {
+		err = errno;
+	}
+	if (err) {
+		Tracer::_err("failed to copy template file to ", out_path, ": ", ::strerror(err));
+		::unlink(out_path.c_str());
+		return false;
+	}
+	return true;
+}
+
+size_t MusicFileCreator::write_template_direct(const Template& templ, int fd) {
+	const int flags = ::fcntl(fd, F_GETFL);
+	if (flags < 0 || !(flags & O_DIRECT))
+		return 0;
+	const size_t size = templ.data.size() & ~(DIRECT_ALIGN - 1);
+	size_t done = 0;
+	while (done < size) {
+		ssize_t n = ::write(fd, templ.direct_data + done, size - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		done += n;
+		// a short write leaves an unaligned offset, the rest is written through the page cache
+		if (n % DIRECT_ALIGN)
+			break;
+	}
+	::fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+	return done;
+}
+
+void MusicFileCreator::preallocate(int fd, size_t size, const std::string& out_path) {
+	// not fatal, the file is written as without the option
+	if (m_opts.preallocate() && !File::preallocate(fd, size)) {
+		Tracer::_info("failed to preallocate ", out_path, ": ", ::strerror(errno));
+	}
+}
+
+bool MusicFileCreator::is_synthesized(const Template& templ, const TrackInfo& ti) const {
+	return m_opts.synthesize_audio() && ti.duration_ms() && templ.format != Template::Format::OTHER;
+}
+
+bool MusicFileCreator::synthesize_audio(const Template& templ, const TrackInfo& ti, const std::string& out_path) {
+	int fd = ::open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (fd < 0) {
+		Tracer::_err("failed to create ", out_path, ": ", ::strerror(errno));
+		return false;
+	}
+	preallocate(fd, (templ.format == Template::Format::MP3) ?
+			AudioSynthesizer::mp3_size(ti.duration_ms()) : AudioSynthesizer::flac_size(ti.duration_ms()), out_path);
+	bool res = (templ.format == Template::Format::MP3) ?
+			m_synthesizer.write_mp3(fd, ti.duration_ms()) : m_synthesizer.write_flac(fd, ti.duration_ms());
+	int err = res ? 0 : errno;
+	if (::close(fd) && !err) {
+		err = errno;
+	}
+	if (err) {
+		Tracer::_err("failed to write audio to ", out_path, ": ", ::strerror(err));
+		::unlink(out_path.c_str());
 		return false;
 	}
 	return true;
 }
 
+size_t MusicFileCreator::copy_template_range(const Template& templ, int fd) {
+	size_t copied = 0;
+#ifdef HAVE_COPY_FILE_RANGE
+	loff_t offset = 0;
+	while (copied < templ.data.size()) {
+		ssize_t n = ::copy_file_range(templ.fd, &offset, fd, nullptr, templ.data.size() - copied, 0);
+		if (n <= 0)
+			break;
+		copied += n;
+	}
+#else
+	(void) templ;
+	(void) fd;
+#endif
+	return copied;
+}
+
+/**
+ * @return @e str cut to at most @e max_len bytes, not in the middle of a utf-8 sequence
+ */
+static std::string utf8_substr(const std::string& str, size_t max_len) {
+	if (str.length() <= max_len)
+		return str;
+	while (max_len > 0 && (static_cast<unsigned char>(str[max_len]) & 0xC0) == 0x80) {
+		max_len--;
+	}
+	return str.substr(0, max_len);
+}
+
 std::string name_to_path_name(const std::string& name) {
-	return (name.length() <= NAME_MAX) ? std::move(Dir::path_escape(name)) : Dir::path_escape(name.substr(0, NAME_MAX));
+	// cut after escaping, the escaped name is what must fit in NAME_MAX
+	return utf8_substr(Dir::path_escape(name), NAME_MAX);
+}
+
+static std::string dir_name(const std::string& name) {
+	std::string path = name_to_path_name(name);
+	return path.empty() ? "Unknown" : path;
+}
+
+std::string MusicFileCreator::make_dir_name(const TrackInfo& ti) const {
+	if (m_opts.layout() == Layout::FLAT)
+		return std::string();
+	std::string path = dir_name(ti.album_artist());
+	if (m_opts.layout() == Layout::HASHED) {
+		// 64K dirs in 2 levels spread the artists evenly
+		char fan_out[8];
+		const uint32_t hash = fnv1a(path);
+		::snprintf(fan_out, sizeof(fan_out), "%02x%c%02x", hash >> 24, Dir::DIR_SEP, (hash >> 16) & 0xFF);
+		path = fan_out + (Dir::DIR_SEP + path);
+	}
+	return path + Dir::DIR_SEP + dir_name(ti.album());
 }
 
 bool MusicFileCreator::make_dir_path(const TrackInfo& ti, std::string& opath) {
-	std::string artist_path(name_to_path_name(ti.album_artist()));
-	std::string album_path(name_to_path_name(ti.album()));
-	if (artist_path.empty())
-		artist_path = "Unknown";
-	if (album_path.empty())
-		album_path = "Unknown";
-	std::string path = artist_path + Dir::DIR_SEP + album_path;
+	std::string path = make_dir_name(ti);
 	if (path == opath) {
 		return true;
 	}
-	Dir dir = Dir(m_opts.output_dir()).sub_dir(artist_path);
-	if (!dir.exists() && !dir.create()) {
-		Tracer::_err("failed to create diretory ", dir.path());
-		return false;
-	}
-	dir = dir.sub_dir(album_path);
-	if (!dir.exists() && !dir.create()) {
-		Tracer::_err("failed to create diretory ", dir.path());
-		return false;
+	Dir dir(m_opts.output_dir());
+	for (size_t start = 0; start < path.size();) {
+		size_t end = std::min(path.find(Dir::DIR_SEP, start), path.size());
+		dir = dir.sub_dir(path.substr(start, end - start));
+		if (!dir.exists() && !dir.create()) {
+			Tracer::_err("failed to create diretory ", dir.path());
+			return false;
+		}
+		start = end + 1;
 	}
 	opath = path;
 	return true;
 }
 
+std::string MusicFileCreator::make_file_path(const TrackInfo& ti, const Template& templ) {
+	std::string dir_path = make_dir_name(ti);
+	return dir_path.empty() ? make_file_name(ti, templ) : dir_path + Dir::DIR_SEP + make_file_name(ti, templ);
+}
+
 std::string MusicFileCreator::make_file_name(const TrackInfo& ti) {
+	return make_file_name(ti, pick_template(ti));
+}
+
+std::string MusicFileCreator::make_file_name(const TrackInfo& ti, const Template& templ) {
 	constexpr const char INDEX_DELIM[] = " - ";
 	static_assert( sizeof(INDEX_DELIM) == sizeof(" - "), "");
 	const int index_width = std::max(2U, static_cast<unsigned>(::log10(ti.tracks_total())));
-	const int reserved_len = m_template_file.extension().length() + 1 + index_width + sizeof(INDEX_DELIM) - 1;
-	const size_t max_name_len = NAME_MAX - reserved_len;
-	std::string fname = ti.title();
-	if (fname.length() > max_name_len) {
-		fname = fname.substr(0, std::min(max_name_len, ti.title().length()));
+	std::string prefix;
+	if (m_opts.layout() == Layout::FLAT) {
+		// the artist and album take at most a third of the name each
+		prefix = utf8_substr(dir_name(ti.album_artist()), NAME_MAX / 3) + INDEX_DELIM
+				+ utf8_substr(dir_name(ti.album()), NAME_MAX / 3) + INDEX_DELIM;
 	}
-	fname = Dir::path_escape(fname);
+	const int reserved_len = prefix.length() + templ.file.extension().length() + 1 + index_width + sizeof(INDEX_DELIM)
+			- 1;
+	const size_t max_name_len = NAME_MAX - reserved_len;
+	const std::string fname = utf8_substr(Dir::path_escape(ti.title()), max_name_len);
 	std::ostringstream os;
 
-	os << std::setw(index_width) << std::setfill('0') << ti.track_num() << INDEX_DELIM << fname << '.'
-			<< m_template_file.extension();
+	os << prefix << std::setw(index_width) << std::setfill('0') << ti.track_num() << INDEX_DELIM << fname << '.'
+			<< templ.file.extension();
 	return os.str();
 }
 
@@ -22,50 +22,349 @@
 #ifndef MUSICFILECREATOR_H_
 #define MUSICFILECREATOR_H_
 
+#include "AliasTable.h"
+#include "ArchiveWriter.h"
+#include "AudioSynthesizer.h"
 #include "File.h"
+#include "FileSyncer.h"
+#include "Manifest.h"
+#include "MusicFileSink.h"
+#include "PathFilter.h"
+#include "RateLimiter.h"
 
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <vector>
 
+namespace TagLib {
+class FileRef;
+}
+
 namespace FMF {
 
 class Context;
 class Options;
 class TrackInfo;
+class VirtualLibrary;
 
 /**
- * creates fake music files from template Options::template_music_file()}
+ * creates fake music files from the templates Options::template_music_files().
+ *
+ * the templates are read at init(), the template of each track is picked by Options::template_weights().
+ * with option --archive or set_sink() the files are tagged in memory and added to a MusicFileSink, e.g. an
+ * ArchiveWriter, instead of the output dir. with option --mount they are added to a VirtualLibrary and tagged when read.
+ * with option --dry-run=tag they are tagged in memory and discarded, with --dry-run=parse they are only counted.
  */
 class MusicFileCreator {
 public:
+	/**
+	 * how the template is copied to a new music file, set by option --copy
+	 */
+	enum class CopyStrategy {
+		/// stream the template file to the new file
+		STREAM,
+		/// write the template data read at init()
+		MEMORY,
+		/// copy the template file in the kernel with copy_file_range(2), falls back to MEMORY if not supported
+		COPY_RANGE
+	};
+
+	/**
+	 * @return false if @e name is not one of stream, memory, copy-range
+	 */
+	static bool parse_copy_strategy(const std::string& name, CopyStrategy& strategy);
+
+	static const char* copy_strategy_name(CopyStrategy strategy);
+
+	/**
+	 * the dirs of the music files under the output dir, set by option --layout
+	 */
+	enum class Layout {
+		/// ARTIST/ALBUM/NN - TITLE.EXT
+		ARTIST,
+		/// XX/XX/ARTIST/ALBUM/NN - TITLE.EXT, XX/XX from the hash of the artist dir
+		HASHED,
+		/// ARTIST - ALBUM - NN - TITLE.EXT, no dirs
+		FLAT
+	};
+
+	/**
+	 * @return false if @e name is not one of artist, hashed, flat
+	 */
+	static bool parse_layout(const std::string& name, Layout& layout);
+
+	static const char* layout_name(Layout layout);
+
+	/**
+	 * how the music files are written with respect to the page cache, set by option --cache-policy
+	 */
+	enum class CachePolicy {
+		/// leave the written files in the page cache
+		KEEP,
+		/// drop the files from the page cache when their album is written
+		DROP,
+		/// write the template data with O_DIRECT, then drop the tags like DROP
+		DIRECT
+	};
+
+	/**
+	 * @return false if @e name is not one of keep, drop, direct
+	 */
+	static bool parse_cache_policy(const std::string& name, CachePolicy& policy);
+
+	static const char* cache_policy_name(CachePolicy policy);
+
+	/**
+	 * how far the music files are created without writing them, set by option --dry-run
+	 */
+	enum class DryRun {
+		/// create and write the music files
+		NONE,
+		/// stop after the track info of the album is parsed
+		PARSE,
+		/// tag the music files in memory and discard them
+		TAG
+	};
+
+	/**
+	 * @return false if @e name is not one of parse, tag
+	 */
+	static bool parse_dry_run(const std::string& name, DryRun& dry_run);
+
+	static const char* dry_run_name(DryRun dry_run);
+
+	/**
+	 * the state of a thread creating music files
+	 */
+	struct Session {
+		Session(MusicFileCreator& creator);
+
+		/// the last dir path, not created again for the next track of the album
+		std::string dir_path;
+		/// the manifest records of the thread, written when its buffer is full and at the end
+		Manifest::Writer manifest;
+		/// the files created by the thread and not synced yet
+		FileSyncer::Batch sync;
+		/// numa node of the thread, whose copy of the template data it writes
+		const size_t node;
+	};
+
 	MusicFileCreator(Context& ctx);
 	~MusicFileCreator();
 
 	bool init();
 
+	/**
+	 * start a new run with the current options and sink, for Engine: the templates read at init() are kept, the
+	 * sync and the rate limits start over in the output dir of the run
+	 */
+	bool restart();
+
+	/**
+	 * finish the archive, the manifest and the sync after the last music file was created, and report the rates
+	 * with options --max-files-per-sec and --max-mbps
+	 *
+	 * @return false if writing the archive or the manifest, or syncing failed
+	 */
+	bool finish();
+
+	/**
+	 * add the music files of the next runs to @e sink instead of the output dir, null for the output dir. not set
+	 * with option --archive
+	 */
+	void set_sink(MusicFileSink* sink) {
+		m_sink = sink;
+	}
+
+	/**
+	 * @return the manifest set by option --manifest, null if not set
+	 */
+	Manifest* manifest() {
+		return m_manifest.get();
+	}
+
 	/**
 	 * create fake music file for track info @e ti
 	 *
 	 * @param ti 		track info for tagging the created file
-	 * @param dir_path	saves the last dir path
+	 * @param session	of the calling thread
 	 *
 	 * @return true - if successful, false if failed
 	 */
-	bool create_music_file(const TrackInfo& ti, std::string& dir_path);
+	bool create_music_file(const TrackInfo& ti, Session& session);
+
+	/**
+	 * @return the escaped file name for track info @e ti: NN - TITLE.EXT, EXT of the template picked for @e ti,
+	 * prefixed by ARTIST - ALBUM - with Layout::FLAT
+	 */
+	std::string make_file_name(const TrackInfo& ti);
+
+	/**
+	 * tag the template of @e ti in memory
+	 *
+	 * @param data	set to the tagged music file
+	 *
+	 * @return the template data, null if tagging failed
+	 */
+	const std::vector<char>* render_music_file(const TrackInfo& ti, std::string& data);
+
+	/**
+	 * @return the library the music files are added to with option --mount, null otherwise
+	 */
+	VirtualLibrary* virtual_library() {
+		return m_library.get();
+	}
 
 private:
-	bool read_template_file();
+	/**
+	 * a template music file read at init()
+	 */
+	struct Template {
+		/**
+		 * formats with their own taglib file type, files of other formats are opened by extension
+		 */
+		enum class Format {
+			MP3, FLAC, OTHER
+		};
+
+		Template(const std::string& path);
+
+		File file;
+		Format format;
+		std::vector<char> data;
+		/// open for CopyStrategy::COPY_RANGE only
+		int fd;
+		/// copy of the data aligned for O_DIRECT, for CachePolicy::DIRECT only
+		char* direct_data;
+	};
+
+	bool read_template_file(Template& templ);
+
+	/**
+	 * @return seed of the random picks for @e ti, a function of the seed, the db file and the track number of @e ti
+	 */
+	uint32_t track_seed(const TrackInfo& ti) const;
+
+	/**
+	 * @return the template for @e ti
+	 */
+	const Template& pick_template(const TrackInfo& ti) const;
+
+	std::string make_file_name(const TrackInfo& ti, const Template& templ);
+
+	/**
+	 * @return the path of the music file for @e ti in @e templ format, relative to the output dir
+	 */
+	std::string make_file_path(const TrackInfo& ti, const Template& templ);
+
+	bool copy_template(const Template& templ, const std::vector<char>& data, const std::string& out_path);
+
+	/**
+	 * copy the template data for numa node @e node, once, in the first thread placed on the node so the copy is
+	 * allocated on it
+	 */
+	void init_node(size_t node);
+
+	/**
+	 * @return the data of @e templ, the copy of the node of @e session with option --numa
+	 */
+	const std::vector<char>& template_data(const Template& templ, const Session& session) const;
+
+	/**
+	 * @return number of bytes of the template data written to @e fd with O_DIRECT, the data up to the last whole
+	 * DIRECT_ALIGN block. O_DIRECT is cleared for writing the rest
+	 */
+	size_t write_template_direct(const Template& templ, int fd);
+
+	/**
+	 * allocate @e size bytes of the new music file @e fd with option --preallocate, so its blocks are contiguous
+	 */
+	void preallocate(int fd, size_t size, const std::string& out_path);
+
+	/**
+	 * @return true if a silent stream of the duration of @e ti is written instead of copying @e templ
+	 */
+	bool is_synthesized(const Template& templ, const TrackInfo& ti) const;
+
+	bool synthesize_audio(const Template& templ, const TrackInfo& ti, const std::string& out_path);
+
+	/**
+	 * @return number of bytes copied from the template file to @e fd, less than the template size if
+	 * copy_file_range(2) is not supported for these files
+	 */
+	size_t copy_template_range(const Template& templ, int fd);
+
+	bool tag_music_file(const Template& templ, const TrackInfo& ti, const std::string& out_path);
+
+	/**
+	 * tag a copy of the template data in memory
+	 *
+	 * @param data	set to the tagged music file
+	 */
+	bool tag_music_data(const Template& templ, const TrackInfo& ti, const std::string& name, std::string& data);
+
+	bool save_tags(TagLib::FileRef& f, const Template& templ, const TrackInfo& ti, const std::string& name);
+
+	/**
+	 * create the music file for @e ti in memory and add it to the sink
+	 */
+	bool sink_music_file(const TrackInfo& ti, Session& session);
+
+	/**
+	 * wait until the rate limits allow the created music file of @e size bytes
+	 */
+	void throttle(uint64_t size);
+
+	void report_rates() const;
+
+	/**
+	 * add the music file for @e ti to the virtual library
+	 */
+	bool add_to_library(const TrackInfo& ti);
+
+	/**
+	 * extend the tagged file @e out_path to its Options::sparse_size() with a hole before its last
+	 * SPARSE_TAIL_SIZE bytes, so only the tags and the first and last audio frames take disk space
+	 */
+	bool make_sparse(const TrackInfo& ti, const std::string& out_path);
 
 	bool make_dir_path(const TrackInfo& ti, std::string& opath);
 
-	std::string make_file_name(const TrackInfo& ti);
+	/**
+	 * @return the escaped dir path for track info @e ti by the Options::layout(), empty with Layout::FLAT
+	 */
+	std::string make_dir_name(const TrackInfo& ti) const;
+
+	/// size of the end of a sparse file that is kept, it holds the last audio frames and any trailing tags
+	static const size_t SPARSE_TAIL_SIZE = 4096;
+	/// alignment of the buffer, offset and size of O_DIRECT writes, the largest logical block size
+	static const size_t DIRECT_ALIGN = 4096;
 
 	Context& m_context;
 	const Options& m_opts;
 	std::mutex m_taglib_lock;
-	const File m_template_file;
-	std::vector<char> m_template_data;
+	std::vector<Template> m_templates;
+	AliasTable m_template_table;
+	const AudioSynthesizer m_synthesizer;
+	std::unique_ptr<ArchiveWriter> m_archive;
+	/// the sink of option --dry-run=tag
+	std::unique_ptr<NullSink> m_dry_run_sink;
+	/// the archive with option --archive, the sink of option --dry-run=tag, or the sink set by set_sink()
+	MusicFileSink* m_sink;
+	/// paths added to the sink, a track picked again is skipped like an existing file. null without a sink and with
+	/// option --dry-run=tag
+	std::unique_ptr<PathFilter> m_sink_paths;
+	std::unique_ptr<VirtualLibrary> m_library;
+	std::unique_ptr<Manifest> m_manifest;
+	std::unique_ptr<FileSyncer> m_syncer;
+	std::unique_ptr<RateLimiter> m_files_limiter;
+	std::unique_ptr<RateLimiter> m_bytes_limiter;
+	/// copies of the template data of each numa node with option --numa, by node and template
+	std::vector<std::vector<std::vector<char>>> m_node_data;
+	std::unique_ptr<std::once_flag[]> m_node_once;
 };
 
 } /* namespace FMF */
@@ -0,0 +1,70 @@
+/*
+ * MusicFileSink.cpp
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#include "MusicFileSink.h"
+
+#include <utility>
+
+namespace FMF {
+
+//-----------------------------------------------------------------------------
+// NullSink
+//-----------------------------------------------------------------------------
+NullSink::NullSink() :
+		m_files(0), m_bytes(0) {
+}
+
+bool NullSink::add(const std::string& /*path*/, std::string&& data) {
+	m_files++;
+	m_bytes += data.size();
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// MemorySink
+//-----------------------------------------------------------------------------
+MemorySink::MemorySink() :
+		m_lock(), m_files() {
+}
+
+bool MemorySink::add(const std::string& path, std::string&& data) {
+	std::lock_guard < std::mutex > locker(m_lock);
+	m_files[path] = std::move(data);
+	return true;
+}
+
+void MemorySink::clear() {
+	std::lock_guard < std::mutex > locker(m_lock);
+	m_files.clear();
+}
+
+//-----------------------------------------------------------------------------
+// CallbackSink
+//-----------------------------------------------------------------------------
+CallbackSink::CallbackSink(const Callback& callback) :
+		m_callback(callback) {
+}
+
+bool CallbackSink::add(const std::string& path, std::string&& data) {
+	return m_callback(path, std::move(data));
+}
+
+} /* namespace FMF */
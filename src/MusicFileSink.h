@@ -0,0 +1,133 @@
+/*
+ * MusicFileSink.h
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#ifndef MUSICFILESINK_H_
+#define MUSICFILESINK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace FMF {
+
+/**
+ * receives the music files tagged in memory instead of writing them to the output dir, e.g. ArchiveWriter for
+ * option --archive, or the sinks of an Engine.
+ *
+ * add() is called by all the creating threads at once.
+ */
+class MusicFileSink {
+public:
+	virtual ~MusicFileSink() {
+	}
+
+	/**
+	 * add the music file @e path, relative to the top of the library, with content @e data
+	 *
+	 * @return false if adding failed, the file is counted as failed
+	 */
+	virtual bool add(const std::string& path, std::string&& data) = 0;
+
+	/**
+	 * called after the last music file of a run was added
+	 *
+	 * @return false if finishing the files failed
+	 */
+	virtual bool close() {
+		return true;
+	}
+};
+
+/**
+ * discards the music files, for measuring the creating of files without writing them
+ */
+class NullSink: public MusicFileSink {
+public:
+	NullSink();
+
+	virtual bool add(const std::string& path, std::string&& data);
+
+	size_t files() const {
+		return m_files;
+	}
+
+	/**
+	 * @return size of the discarded files
+	 */
+	uint64_t bytes() const {
+		return m_bytes;
+	}
+
+private:
+	std::atomic<size_t> m_files;
+	std::atomic<uint64_t> m_bytes;
+};
+
+/**
+ * keeps the music files in memory by path
+ */
+class MemorySink: public MusicFileSink {
+public:
+	MemorySink();
+
+	virtual bool add(const std::string& path, std::string&& data);
+
+	/**
+	 * @return the files added by path, not to be called while files are added
+	 */
+	const std::map<std::string, std::string>& files() const {
+		return m_files;
+	}
+
+	/**
+	 * remove the files added, e.g. between runs
+	 */
+	void clear();
+
+private:
+	std::mutex m_lock;
+	std::map<std::string, std::string> m_files;
+};
+
+/**
+ * passes the music files to a function, which is called by all the creating threads at once
+ */
+class CallbackSink: public MusicFileSink {
+public:
+	/**
+	 * @param callback	returns false if the file failed
+	 */
+	typedef std::function<bool(const std::string& path, std::string&& data)> Callback;
+
+	CallbackSink(const Callback& callback);
+
+	virtual bool add(const std::string& path, std::string&& data);
+
+private:
+	const Callback m_callback;
+};
+
+} /* namespace FMF */
+#endif /* MUSICFILESINK_H_ */
@@ -25,6 +25,8 @@
 #include "TrackInfo.h"
 #include "Tracer.h"
 #include "MusicFileCreator.h"
+#include "Launcher.h"
+#include "ThreadTuner.h"
 
 #include <sstream>
 #include <thread>
@@ -45,7 +47,7 @@ private:
 };
 
 MusicFilesGenerator::MusicFilesGenerator(Context& ctx) :
-		m_context(ctx) {
+		m_context(ctx), m_tuner(nullptr) {
 }
 
 MusicFilesGenerator::~MusicFilesGenerator() {
@@ -55,10 +57,23 @@ void MusicFilesGenerator::operator ()(MusicFileCreator& creator) {
 	Tracer::_debug("generator enter thread ", std::this_thread::get_id());
 	CDDBParser parser(m_context);
 	std::string db_file_path;
-	std::string last_dir_path;
-	while (!Context::stopped() && m_context.pick_db_file(db_file_path)) {
+	MusicFileCreator::Session session(creator);
+	while (!Context::stopped()) {
+		if (m_tuner) {
+			m_tuner->wait_active(Launcher::thread_index());
+		}
+		{
+			Context::StageTimer timer(m_context, Context::Stage::PICK);
+			if (!m_context.pick_db_file(db_file_path))
+				break;
+		}
 		try {
-			create_fake_music_files(creator, parse_cddb_file(parser, db_file_path), last_dir_path);
+			if (m_context.synthetic_albums()) {
+				create_fake_music_files(creator, synthesize_album(db_file_path), session);
+			}
+			else {
+				create_fake_music_files(creator, parse_cddb_file(parser, db_file_path), session);
+			}
 		}
 		catch (ParseFailureException& e) {
 			continue;
@@ -68,17 +83,23 @@ void MusicFilesGenerator::operator ()(MusicFileCreator& creator) {
 			break;
 		}
 	}
+	if (m_tuner) {
+		// no more albums, the waiting threads run to exit
+		m_tuner->stop();
+	}
 	Tracer::_debug("generator exit thread ", std::this_thread::get_id());
 }
 
 std::vector<TrackInfo> MusicFilesGenerator::parse_cddb_file(CDDBParser& parser, const std::string& cddb_file) {
+	Context::StageTimer timer(m_context, Context::Stage::PARSE);
 	if (!File(cddb_file).exists()) {
-		m_context.on_parse_failed(cddb_file);
+		m_context.on_parse_failed(cddb_file, Context::ParseFailure::MISSING);
 		Tracer::_err("file not found ", cddb_file, " (if cddb directory changed use --update to recreate the cache)");
 		throw ParseFailureException(cddb_file);
 	}
 	if (!parser.parse(cddb_file)) {
-		m_context.on_parse_failed(cddb_file);
+		m_context.on_parse_failed(cddb_file,
+				parser.is_read_failed() ? Context::ParseFailure::UNREADABLE : Context::ParseFailure::INVALID);
 		Tracer::_err("failed Parser: ", parser);
 		throw ParseFailureException(cddb_file);
 	}
@@ -86,13 +107,25 @@ std::vector<TrackInfo> MusicFilesGenerator::parse_cddb_file(CDDBParser& parser,
 	return parser.getTracks();
 }
 
+std::vector<TrackInfo> MusicFilesGenerator::synthesize_album(const std::string& album_id) {
+	Context::StageTimer timer(m_context, Context::Stage::PARSE);
+	std::vector<TrackInfo> tracks = m_context.synthetic_albums()->tracks(album_id);
+	if (tracks.empty()) {
+		m_context.on_parse_failed(album_id);
+		throw ParseFailureException(album_id);
+	}
+	m_context.on_parse_success();
+	return tracks;
+}
+
 void MusicFilesGenerator::create_fake_music_files(MusicFileCreator& creator, const std::vector<TrackInfo>& tracks,
-		std::string& dir_path) {
+		MusicFileCreator::Session& session) {
 	for (auto& ti : tracks) {
 		if (Context::stopped())
 			break;
-		creator.create_music_file(ti, dir_path);
+		creator.create_music_file(ti, session);
 	}
+	session.sync.end_album();
 }
 
 } /* namespace FMF */
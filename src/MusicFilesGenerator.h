@@ -22,6 +22,7 @@
 #ifndef FAKEMUSICFILES_H_
 #define FAKEMUSICFILES_H_
 
+#include "MusicFileCreator.h"
 #include "TrackInfo.h"
 
 #include <string>
@@ -31,7 +32,7 @@ namespace FMF {
 
 class CDDBParser;
 class Context;
-class MusicFileCreator;
+class ThreadTuner;
 
 /**
  *
@@ -43,11 +44,21 @@ public:
 
 	void operator()(MusicFileCreator& creator);
 
+	/**
+	 * set the tuner of the number of active threads with option --threads=auto
+	 */
+	void set_tuner(ThreadTuner* tuner) {
+		m_tuner = tuner;
+	}
+
 private:
 	std::vector<TrackInfo> parse_cddb_file(CDDBParser& parser, const std::string& cddb_file);
-	void create_fake_music_files(MusicFileCreator& creator, const std::vector<TrackInfo>& tracks, std::string& dir_path);
+	std::vector<TrackInfo> synthesize_album(const std::string& album_id);
+	void create_fake_music_files(MusicFileCreator& creator, const std::vector<TrackInfo>& tracks,
+			MusicFileCreator::Session& session);
 
 	Context& m_context;
+	ThreadTuner* m_tuner;
 };
 
 } /* namespace FMF */
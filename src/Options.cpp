@@ -21,16 +21,24 @@
  */
 #include "Options.h"
 #include "config.h"
+#include "File.h"
 #include "Tracer.h"
 
+#include <ctype.h>
 #include <errno.h>
 #include <limits.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <taglib/fileref.h>
 #include <unistd.h>
+#include <cmath>
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <thread>
 
 namespace FMF {
 
@@ -39,11 +47,21 @@ namespace FMF {
  */
 const int Options::MAX_CDS = 10e6;
 
+/**
+ * default number of cds for option --benchmark
+ */
+const int Options::BENCHMARK_CDS = 100;
+
 /**
  * max number of threads to accept in command line option -c, --threads
  */
 const int Options::MAX_THREADS = 10e6;
 
+/**
+ * number of threads launched per cpu with -c auto, creating files may be i/o bound
+ */
+const int Options::AUTO_THREADS_PER_CPU = 4;
+
 /**
  * default value for command line option -t, --template
  */
@@ -95,6 +113,151 @@ struct option Options::s_options[] = {
 											required_argument,
 											0,
 											'c' },
+										{
+											"genre-weights",
+											required_argument,
+											&s_long_opt,
+											'g' },
+										{
+											"dedup-albums",
+											no_argument,
+											&s_long_opt,
+											'U' },
+										{
+											"year",
+											required_argument,
+											&s_long_opt,
+											'Y' },
+										{
+											"min-tracks",
+											required_argument,
+											&s_long_opt,
+											'T' },
+										{
+											"max-tracks",
+											required_argument,
+											&s_long_opt,
+											'M' },
+										{
+											"artist-initial",
+											required_argument,
+											&s_long_opt,
+											'I' },
+										{
+											"dgenre",
+											required_argument,
+											&s_long_opt,
+											'G' },
+										{
+											"format-mix",
+											required_argument,
+											&s_long_opt,
+											'f' },
+										{
+											"synthetic",
+											optional_argument,
+											&s_long_opt,
+											's' },
+										{
+											"make-cddb",
+											optional_argument,
+											&s_long_opt,
+											'm' },
+										{
+											"seed",
+											required_argument,
+											&s_long_opt,
+											'r' },
+										{
+											"copy",
+											required_argument,
+											&s_long_opt,
+											'y' },
+										{
+											"archive",
+											required_argument,
+											&s_long_opt,
+											'x' },
+										{
+											"mount",
+											required_argument,
+											&s_long_opt,
+											'l' },
+										{
+											"manifest",
+											required_argument,
+											&s_long_opt,
+											'j' },
+										{
+											"manifest-format",
+											required_argument,
+											&s_long_opt,
+											'k' },
+										{
+											"layout",
+											required_argument,
+											&s_long_opt,
+											'L' },
+										{
+											"sync",
+											required_argument,
+											&s_long_opt,
+											'S' },
+										{
+											"cache-policy",
+											required_argument,
+											&s_long_opt,
+											'C' },
+										{
+											"max-files-per-sec",
+											required_argument,
+											&s_long_opt,
+											'F' },
+										{
+											"max-mbps",
+											required_argument,
+											&s_long_opt,
+											'B' },
+										{
+											"cpu-affinity",
+											optional_argument,
+											&s_long_opt,
+											'A' },
+										{
+											"numa",
+											no_argument,
+											&s_long_opt,
+											'N' },
+										{
+											"sparse",
+											required_argument,
+											&s_long_opt,
+											'p' },
+										{
+											"synthesize-audio",
+											no_argument,
+											&s_long_opt,
+											'a' },
+										{
+											"preallocate",
+											no_argument,
+											&s_long_opt,
+											'P' },
+										{
+											"dry-run",
+											required_argument,
+											&s_long_opt,
+											'R' },
+										{
+											"benchmark",
+											optional_argument,
+											&s_long_opt,
+											'b' },
+										{
+											"daemon",
+											required_argument,
+											&s_long_opt,
+											'D' },
 										{
 											"help",
 											no_argument,
@@ -146,9 +309,77 @@ Options:
     -i, --in         Path to a CDDB file.
                      This can be used instead of -d in order to use a specific CDDB file as input.
     
+        --synthetic[=<key>=<value>,...]
+                     Generate the albums track info in memory instead of reading a CDDB.
+                     This can be used instead of -d for stressing the writing of music files.
+                     Keys and values (a value is either <n> or a range <min>-<max>):
+                         albums-per-artist  Default: 1-5
+                         tracks             tracks per album. Default: 8-16
+                         name-length        length of names in characters. Default: 4-30
+                         unicode            percent of names in a non ascii script. Default: 10
+    
     -o, --out        Output directory.
                      This is the directory where fake music files will be generated.
-                     Sub directories will be created for the titles: ARTIST/ALBUM/TITLE
+                     Sub directories will be created for the titles: ARTIST/ALBUM/TITLE (see --layout)
+    
+        --archive    Stream the fake music files into a tar archive instead of the output directory (-o).
+                     <file> or - for stdout. e.g. --archive - | ssh host tar xf -
+                     The files are tagged in memory and written by a single thread, names longer than 100 bytes
+                     or not ascii are stored in pax headers. Messages are output to stderr when writing to stdout.
+    
+        --mount      Serve the fake music files from memory at a mount point with fuse, instead of the output directory (-o).
+                     The directories are listed from the generated albums, nothing is written to disk. A file is
+                     tagged in memory when it is first listed with its size or read, the tagged parts of the last 4096
+                     files and the size of every tagged file are kept in memory.
+                     Serves until unmounted: fusermount3 -u <mount point>
+                     Requires fmf built with fuse3.
+    
+        --manifest   Write a manifest of the created fake music files to <file>: the path relative to the output
+                     directory or in the archive, the size, and the album, artist, title, genre, comment, year and track
+                     tags. The records of each thread are buffered and appended in blocks, in the order they are flushed.
+    
+        --manifest-format
+                     Format of the manifest:
+                         jsonl   a JSON object per line
+                         binary  a header of the magic FMFMNFST, version, reserved and number of records, then for each
+                                 record its length, size, year, track, and the path and tag strings as length and UTF-8.
+                                 Integers are little endian.
+                     Default: jsonl
+    
+        --layout     The directories of the fake music files under the output directory:
+                         artist  ARTIST/ALBUM/NN - TITLE
+                         hashed  XX/XX/ARTIST/ALBUM/NN - TITLE, XX/XX of the hash of the artist, for bounded directory
+                                 sizes in very large libraries
+                         flat    ARTIST - ALBUM - NN - TITLE, all the files in the output directory
+                     Also applies to the paths in --archive and --mount.
+                     Default: artist
+    
+        --sync       How the fake music files are synced to disk:
+                         none     left to the kernel writeback
+                         album    the writeback of each file is started when it is created, the files of an album
+                                  are synced with fdatasync when the album is done
+                         batch:N  like album, every N files of a thread (N from 1 to 1024)
+                         end      the file system of the output directory is synced once with syncfs at the end
+                     The time spent in each is reported at the end, and as the sync stage with --benchmark.
+                     Default: none
+    
+        --cache-policy
+                     How the fake music files are written with respect to the page cache, to keep the page cache of
+                     a shared host for its other users:
+                         keep    leave the files in the page cache
+                         drop    the writeback of each file is started when it is created, and the files of an album
+                                 are dropped from the page cache with posix_fadvise when the album is done
+                         direct  write the template audio with O_DIRECT, then drop the tags like drop. Requires
+                                 --copy=memory, file systems without O_DIRECT are written through the page cache.
+                     With --sync=batch:N the files are dropped every N files.
+                     Default: keep
+    
+        --max-files-per-sec
+                     Max number of fake music files created per second, e.g. 0.5 or 2000.
+                     The limit is shared by all the threads, and the achieved rate is reported at the end.
+    
+        --max-mbps   Max MB (10^6 bytes) of fake music files written per second, e.g. 20.
+                     Can be set with --max-files-per-sec, the lower of the two applies.
     
     -n, --num-albums Number of CDDB files to use for generating fake music files.
                      Default: 1
@@ -157,15 +388,132 @@ Options:
                      fmf creates a cache with lists of all the CDDB files by scanning the CDDB directory (-d).
                      Use this option to force a re-scan of the CDDB directory.
                      The cache will be automatically updated if the value of -d option does not match the previously cached directory.
+                     CDDB files that fail parsing are marked as bad in the cache and never picked again, until the
+                     cache is updated. Files that could not be read or are missing are not marked.
     
     -t, --template   The template music file to use for creating fake music files.
                      This file will be copied and renamed and then tagged for each generated fake music file.
                      Keep it small if generating many files.
+                     Repeat for a mix of formats, see --format-mix.
                      Default: %DEFAULT_TEMPLATE%
     
-    -c, --threads    The number of threads to use.
+        --format-mix Relative weights of the template formats: <extension>=<weight>[,<extension>=<weight>...]
+                     e.g. mp3=70,flac=30 with -t template.mp3 -t template.flac
+                     The template of each track is picked by its weight, the weight of a format is split between
+                     its templates. Formats not listed are never picked.
+                     Default: all the templates are picked with equal weights.
+    
+        --synthesize-audio
+                     Write silent audio of the track duration instead of copying the template audio, for mp3 and flac
+                     templates. The duration is taken from the track frame offsets and the disc length of the CDDB file.
+                     mp3 files are 128kbps 48kHz mono with an Info header, flac files 44.1kHz 16 bit mono.
+                     Tracks without a known duration are copied from the template.
+    
+        --sparse     Apparent size of the fake music files: <size> or a range <min>-<max>, size is <n>[K|M|G]
+                     e.g. 3M-12M
+                     The tagged template is extended to the size with a hole before its last 4K, so only the tags
+                     and the first and last audio frames take disk space. The size of each file is picked by --seed.
+                     Files larger than the size are not changed.
+    
+        --copy       How the template music file is copied to each fake music file:
+                         stream      stream the template file
+                         memory      write the template data read at start
+                         copy-range  copy in the kernel with copy_file_range(2), falls back to memory if not supported
+                     Default: memory
+    
+        --preallocate
+                     Allocate the disk space of each fake music file with fallocate(2) before writing it, the size of
+                     the template or of the synthesized audio, so its blocks are contiguous. The tags usually fit in the
+                     padding of the template and are saved in place.
+                     Ignored on file systems without fallocate. Not supported with --sparse and --copy=stream.
+    
+    -c, --threads    The number of threads to use, or auto.
+                     With auto 4 threads per cpu are launched, and the number of active threads is tuned while running:
+                     the files per second are measured every 0.5s and the number of threads is moved towards the
+                     highest rate. The number with the highest rate is reported in the summary.
                      Default: 1
     
+        --cpu-affinity
+                     Pin each thread to a single cpu, round robin over the cpus the process may run on, or over the
+                     given list of cpus: --cpu-affinity=<cpu>|<first>-<last>[,...] e.g. --cpu-affinity=0-7,16-23
+    
+        --numa       Place the threads round robin on the numa nodes, each on the cpus of its node (one cpu with
+                     --cpu-affinity). Each node gets its own copy of the template data, and the buffers of a thread
+                     are allocated on its node.
+    
+        --genre-weights
+                     Relative weights for picking CDDB genres: <genre>=<weight>[,<genre>=<weight>...]
+                     e.g. rock=5,jazz=1
+                     Genres not listed are never picked.
+                     Default: genres are weighted by their number of CDDB files.
+    
+        --dedup-albums
+                     Pick only one CDDB file of each album, files of the same artist and title (ignoring case, spaces
+                     and punctuation) are never picked again. The duplicates are marked in the CDDB cache once, when
+                     the cache is created or on the first run with this option.
+    
+        --year       Pick only CDDB files of a year (DYEAR) or a range of years: <year>|<min>-<max> e.g. 1990-1999
+    
+        --min-tracks
+                     Pick only CDDB files of at least this number of tracks.
+    
+        --max-tracks
+                     Pick only CDDB files of at most this number of tracks.
+    
+        --artist-initial
+                     Pick only CDDB files whose artist starts with one of the letters or digits, ignoring case:
+                     <c>|<first>-<last>[,...] e.g. --artist-initial=a-c,x
+    
+        --dgenre     Pick only CDDB files of one of the genres of DGENRE, ignoring case, spaces and punctuation:
+                     <genre>[,<genre>...] e.g. --dgenre=hip-hop,jazz
+                     The year, number of tracks, artist initial and DGENRE of the CDDB files are indexed in the CDDB
+                     cache once, when the cache is created or on the first run with one of these options, so the
+                     files that don't match are never read.
+    
+        --seed       Seed for the random picks and generated data, for repeating a run.
+                     Default: a random seed
+    
+        --make-cddb[=<key>=<value>,...]
+                     Write a synthetic CDDB of -n files to the CDDB directory (-d) instead of generating music files,
+                     with a sub directory for each of the 11 freedb genres.
+                     Keys and values (a value is either <n> or a range <min>-<max>):
+                         charsets     <charset>:<weight>/... charsets mix of the files.
+                                      Default: utf-8:40/ascii:30/iso-8859-1:15/windows-1251:5/shift_jis:5/gb18030:5
+                                      Supported: ascii, utf-8, iso-8859-1, windows-1252, iso-8859-7, koi8-r,
+                                      windows-1251, iso-8859-8, shift_jis, euc-jp, gb18030
+                         tracks       tracks per file. Default: 1-20
+                         size         file size in bytes. Default: 512-4096
+                         name-length  length of names in characters. Default: 4-30
+                         malformed    percent of files that fail parsing. Default: 1
+    
+        --benchmark[=<key>=<value>,...]
+                     Benchmark the creating of fake music files in the output directory (-o) instead of generating them once.
+                     The same seeded workload of -n albums (default 100) from -d, -i or --synthetic is run for each number
+                     of threads and copy strategy, in a sub directory of the output directory that is removed after the run.
+                     Reports files/sec, MB/s, CPU utilization and the time per file of each stage as a table and as JSON.
+                     The seed is 0 unless --seed is set.
+                     With --dry-run the dry run is benchmarked, without the output directory.
+                     Keys and values:
+                         threads  <n>/... numbers of threads. Default: 1/2/4/... up to the number of CPUs
+                         copy     <strategy>/... copy strategies (see --copy). Default: stream/memory/copy-range
+                         json     file to write the JSON report to. Default: output the JSON report after the table
+    
+        --dry-run    Create the fake music files without writing them, instead of the output directory (-o), to measure
+                     the picking, parsing and tagging without the file system:
+                         parse  stop after the track info of each album is parsed, each track is counted as created
+                         tag    tag each music file in memory like --archive, then discard it. Tracks picked again are
+                                not skipped
+                     The results are reported like the results of writing the files.
+    
+        --daemon     Keep the CDDB index (-d) or the --synthetic albums, the templates and the options resident, and run
+                     generation jobs sent over the local unix socket --daemon=<socket path>, one at a time.
+                     The socket is created with mode 0600, a stale socket of the same user is replaced.
+                     A job is a line of keys and values: out=<dir>,albums=<n>[,seed=<n>][,layout=<layout>]
+                     Keys not sent are taken from -n, --seed and --layout, the seed is random if --seed is not set.
+                     While a job runs its progress is sent back as lines "progress created=<n> skipped=<n> failed=<n>",
+                     then "done created=<n> skipped=<n> failed=<n> bytes=<n> seconds=<s>", or "error <message>".
+                     More jobs can be sent on the same connection. Stopped by SIGINT, SIGQUIT or SIGHUP.
+    
     -v, --verbose    Increase output verbosity.
     
         --version    Output version.
@@ -213,10 +561,21 @@ int str2int(const char* arg) {
 }
 
 Options::Options() :
-		m_db_dir(), m_output_dir(), m_num_albums(0), m_db_file(), m_template_music_file(DEFAULT_TEMPLATE), m_skip_empty_titles(
-				true), m_verbosity(0), m_update_cache(false), m_num_threads(0), m_valid(true), m_output_dir_set(false), m_db_dir_set(
-				false), m_num_albums_set(false), m_db_file_set(false), m_template_music_file_set(false), m_num_threads_set(
-				false) {
+		m_db_dir(), m_output_dir(), m_archive_file(), m_mount_dir(), m_manifest_file(),
+				m_manifest_format(Manifest::Format::JSONL), m_num_albums(0), m_db_file(),
+				m_template_music_files { DEFAULT_TEMPLATE }, m_skip_empty_titles(true), m_verbosity(0),
+				m_update_cache(false), m_num_threads(0), m_auto_threads(false), m_genre_weights(),
+				m_dedup_albums(false), m_album_filter(), m_format_mix(), m_template_weights(), m_synthetic_params(),
+				m_make_cddb_params(), m_benchmark_params(), m_daemon_socket(),
+				m_copy_strategy(MusicFileCreator::CopyStrategy::MEMORY), m_layout(MusicFileCreator::Layout::ARTIST),
+				m_sync_params(), m_cache_policy(MusicFileCreator::CachePolicy::KEEP),
+				m_dry_run(MusicFileCreator::DryRun::NONE), m_max_files_per_sec(0), m_max_mbps(0), m_placement(),
+				m_sparse_size { 0, 0 }, m_synthesize_audio(false), m_preallocate(false), m_seed(0), m_valid(true),
+				m_info_requested(false), m_output_dir_set(false), m_archive_set(false), m_mount_set(false),
+				m_manifest_set(false), m_manifest_format_set(false), m_db_dir_set(false), m_num_albums_set(false),
+				m_db_file_set(false), m_template_music_file_set(false), m_num_threads_set(false),
+				m_synthetic_set(false), m_make_cddb_set(false), m_benchmark_set(false), m_daemon_set(false),
+				m_engine(false), m_sparse_set(false), m_seed_set(false) {
 }
 
 Options::~Options() {
@@ -239,10 +598,151 @@ bool Options::parse(int argc, char** argv) {
 			switch (s_long_opt) {
 			case 'v':
 				version(std::cout);
-				::exit(EXIT_SUCCESS);
+				m_info_requested = true;
+				return false;
 			case 'u':
 				usage(argv[0], std::cout);
-				::exit(EXIT_SUCCESS);
+				m_info_requested = true;
+				return false;
+			case 'g':
+				parse_weights("--genre-weights", "genre", optarg, m_genre_weights);
+				break;
+			case 'U':
+				m_dedup_albums = true;
+				break;
+			case 'Y': {
+				SyntheticAlbums::Range years;
+				if (!years.parse(optarg)) {
+					Tracer::cerr("--year (", optarg, ") must be a year <n> or a range <min>-<max>");
+					m_valid = false;
+					break;
+				}
+				m_album_filter.min_year = years.min;
+				m_album_filter.max_year = years.max;
+				break;
+			}
+			case 'T':
+				parse_tracks("--min-tracks", optarg, m_album_filter.min_tracks);
+				break;
+			case 'M':
+				parse_tracks("--max-tracks", optarg, m_album_filter.max_tracks);
+				break;
+			case 'I':
+				if (!m_album_filter.parse_initials(optarg)) {
+					Tracer::cerr("--artist-initial (", optarg, ") must be letters or digits <c>|<first>-<last>[,...]");
+					m_valid = false;
+				}
+				break;
+			case 'G':
+				if (!m_album_filter.parse_dgenres(optarg)) {
+					Tracer::cerr("--dgenre (", optarg, ") must be a list of genres <genre>[,<genre>...]");
+					m_valid = false;
+				}
+				break;
+			case 'f':
+				parse_weights("--format-mix", "format", optarg, m_format_mix);
+				break;
+			case 's':
+				if (optarg && !m_synthetic_params.parse(optarg)) {
+					m_valid = false;
+				}
+				m_synthetic_set = true;
+				break;
+			case 'm':
+				if (optarg && !m_make_cddb_params.parse(optarg)) {
+					m_valid = false;
+				}
+				m_make_cddb_set = true;
+				break;
+			case 'r':
+				parse_seed(optarg);
+				break;
+			case 'y':
+				if (!MusicFileCreator::parse_copy_strategy(optarg, m_copy_strategy)) {
+					Tracer::cerr("--copy (", optarg, ") must be one of stream, memory, copy-range");
+					m_valid = false;
+				}
+				break;
+			case 'L':
+				if (!MusicFileCreator::parse_layout(optarg, m_layout)) {
+					Tracer::cerr("--layout (", optarg, ") must be one of artist, hashed, flat");
+					m_valid = false;
+				}
+				break;
+			case 'S':
+				if (!m_sync_params.parse(optarg)) {
+					Tracer::cerr("--sync (", optarg, ") must be one of none, album, batch:<n> with n from 1 to ",
+							FileSyncer::MAX_BATCH_SIZE, ", end");
+					m_valid = false;
+				}
+				break;
+			case 'C':
+				if (!MusicFileCreator::parse_cache_policy(optarg, m_cache_policy)) {
+					Tracer::cerr("--cache-policy (", optarg, ") must be one of keep, drop, direct");
+					m_valid = false;
+				}
+				break;
+			case 'F':
+				parse_rate("--max-files-per-sec", optarg, m_max_files_per_sec);
+				break;
+			case 'B':
+				parse_rate("--max-mbps", optarg, m_max_mbps);
+				break;
+			case 'A':
+				if (optarg && !Launcher::Placement::parse_cpus(optarg, m_placement.cpus)) {
+					Tracer::cerr("--cpu-affinity (", optarg, ") must be a list of cpus <cpu>|<first>-<last>[,...]");
+					m_valid = false;
+				}
+				m_placement.pin_cpus = true;
+				break;
+			case 'N':
+				m_placement.numa = true;
+				break;
+			case 'a':
+				m_synthesize_audio = true;
+				break;
+			case 'P':
+				m_preallocate = true;
+				break;
+			case 'p':
+				parse_sparse(optarg);
+				break;
+			case 'x':
+				m_archive_file = optarg;
+				m_archive_set = true;
+				break;
+			case 'l':
+				set_real_path(m_mount_dir, optarg, "--mount", "mount dir");
+				m_mount_set = true;
+				break;
+			case 'j':
+				m_manifest_file = optarg;
+				m_manifest_set = true;
+				break;
+			case 'k':
+				if (!Manifest::parse_format(optarg, m_manifest_format)) {
+					Tracer::cerr("--manifest-format (", optarg, ") must be one of jsonl, binary");
+					m_valid = false;
+				}
+				m_manifest_format_set = true;
+				break;
+			case 'R':
+				if (!MusicFileCreator::parse_dry_run(optarg, m_dry_run)) {
+					Tracer::cerr("--dry-run (", optarg, ") must be one of parse, tag");
+					m_valid = false;
+				}
+				break;
+			case 'b':
+				if (optarg && !m_benchmark_params.parse(optarg)) {
+					m_valid = false;
+				}
+				m_benchmark_set = true;
+				break;
+			case 'D':
+				m_daemon_socket = optarg;
+				m_daemon_set = true;
+				m_engine = true;
+				break;
 			}
 			break;
 		case 'd':
@@ -270,7 +770,11 @@ bool Options::parse(int argc, char** argv) {
 			m_db_file_set = true;
 			break;
 		case 't':
-			set_real_path(m_template_music_file, optarg, "-t, --template", "template music file");
+			if (!m_template_music_file_set) {
+				m_template_music_files.clear();
+			}
+			m_template_music_files.push_back("");
+			set_real_path(m_template_music_files.back(), optarg, "-t, --template", "template music file");
 			m_template_music_file_set = true;
 			break;
 		case 'v':
@@ -280,12 +784,18 @@ bool Options::parse(int argc, char** argv) {
 			m_update_cache = true;
 			break;
 		case 'c':
-			m_num_threads = str2int(optarg);
+			if (std::string(optarg) == "auto") {
+				m_auto_threads = true;
+			}
+			else {
+				m_num_threads = str2int(optarg);
+			}
 			m_num_threads_set = true;
 			break;
 		case 'h':
 			usage(argv[0], std::cout);
-			::exit(EXIT_SUCCESS);
+			m_info_requested = true;
+			return false;
 		case '?':
 			if (::optopt) {
 				Tracer::cerr("unknown option: ", (char) ::optopt);
@@ -323,6 +833,47 @@ bool Options::parse(int argc, char** argv) {
 	return m_valid;
 }
 
+bool Options::set_output_dir(const std::string& output_dir) {
+	if (output_dir.empty()) {
+		m_output_dir.clear();
+		return true;
+	}
+	char path[PATH_MAX];
+	struct stat sb;
+	if (!::realpath(output_dir.c_str(), path) || ::stat(path, &sb) || !S_ISDIR(sb.st_mode) || ::access(path, W_OK))
+		return false;
+	m_output_dir = path;
+	return true;
+}
+
+bool Options::set_num_albums(size_t num_albums) {
+	if (num_albums == 0 || num_albums > static_cast<size_t>(MAX_CDS))
+		return false;
+	m_num_albums = num_albums;
+	return true;
+}
+
+bool Options::set_num_threads(size_t num_threads) {
+	if (num_threads == 0 || num_threads > static_cast<size_t>(MAX_THREADS))
+		return false;
+	m_num_threads = num_threads;
+	return true;
+}
+
+bool Options::set_copy_strategy(MusicFileCreator::CopyStrategy copy_strategy) {
+	if (!is_copy_strategy_supported(copy_strategy))
+		return false;
+	m_copy_strategy = copy_strategy;
+	return true;
+}
+
+bool Options::is_copy_strategy_supported(MusicFileCreator::CopyStrategy copy_strategy) const {
+	if (m_cache_policy == MusicFileCreator::CachePolicy::DIRECT
+			&& copy_strategy != MusicFileCreator::CopyStrategy::MEMORY)
+		return false;
+	return !m_preallocate || copy_strategy != MusicFileCreator::CopyStrategy::STREAM;
+}
+
 void Options::set_real_path(std::string& var, const char* val, const char* opt, const char* name) {
 	char buf[PATH_MAX];
 	const char* path = ::realpath(val, buf);
@@ -337,8 +888,28 @@ void Options::set_real_path(std::string& var, const char* val, const char* opt,
 }
 
 void Options::validate() {
+	if (!m_seed_set) {
+		// benchmark runs are repeatable by default
+		m_seed = m_benchmark_set ? 0 : std::random_device()();
+	}
 	if (m_template_music_file_set) {
-		set_real_path(m_template_music_file, m_template_music_file.c_str(), "-t, --template", "template music file");
+		for (auto& path : m_template_music_files) {
+			set_real_path(path, path.c_str(), "-t, --template", "template music file");
+		}
+	}
+	if (m_make_cddb_set) {
+		validate_make_cddb();
+		return;
+	}
+	if (m_benchmark_set) {
+		validate_benchmark();
+	}
+	if (m_engine) {
+		validate_engine();
+	}
+	if (m_db_file_set && m_synthetic_set) {
+		Tracer::cerr("can't set both --synthetic and db file (-i, --in)");
+		set_valid(false);
 	}
 	if (m_db_file_set) {
 		validate_file("-i, --in", m_db_file_set, "db file", m_db_file.c_str(), R_OK);
@@ -346,22 +917,84 @@ void Options::validate() {
 		if (m_num_albums_set) {
 			Tracer::cerr("ignoring -n ", m_num_albums, " when [-i, --in] is set");
 		}
+		if (!m_genre_weights.empty()) {
+			Tracer::cerr("ignoring --genre-weights when [-i, --in] is set");
+		}
+		if (m_dedup_albums) {
+			Tracer::cerr("ignoring --dedup-albums when [-i, --in] is set");
+		}
+		if (m_album_filter.is_set()) {
+			Tracer::cerr("ignoring the album filters when [-i, --in] is set");
+		}
+	}
+	else if (m_synthetic_set) {
+		if (m_db_dir_set) {
+			Tracer::cerr("can't set both --synthetic and db dir (-d, --cddb)");
+			set_valid(false);
+		}
+		if (m_update_cache) {
+			Tracer::cerr("ignoring -u when --synthetic is set");
+			m_update_cache = false;
+		}
+		if (m_dedup_albums) {
+			Tracer::cerr("ignoring --dedup-albums when --synthetic is set");
+			m_dedup_albums = false;
+		}
+		if (m_album_filter.is_set()) {
+			Tracer::cerr("ignoring the album filters when --synthetic is set");
+			m_album_filter = AlbumIndex::Filter();
+		}
 	}
 	else {
 		validate_dir("-d, --cddb", m_db_dir_set, "db dir", m_db_dir.c_str(), R_OK);
 	}
-	if (!m_update_cache || m_output_dir_set) {
+	if (m_archive_set) {
+		validate_archive();
+	}
+	if (m_mount_set) {
+		validate_mount();
+	}
+	if (m_manifest_set || m_manifest_format_set) {
+		validate_manifest();
+	}
+	if (m_preallocate) {
+		validate_preallocate();
+	}
+	if (m_dry_run != MusicFileCreator::DryRun::NONE) {
+		validate_dry_run();
+	}
+	if (m_max_files_per_sec > 0 || m_max_mbps > 0) {
+		validate_rates();
+	}
+	if (m_album_filter.min_tracks > m_album_filter.max_tracks) {
+		Tracer::cerr("--min-tracks (", m_album_filter.min_tracks, ") is more than --max-tracks (",
+				m_album_filter.max_tracks, ")");
+		set_valid(false);
+	}
+	if (m_cache_policy == MusicFileCreator::CachePolicy::DIRECT
+			&& m_copy_strategy != MusicFileCreator::CopyStrategy::MEMORY) {
+		Tracer::cerr("--cache-policy=direct requires --copy=memory");
+		set_valid(false);
+	}
+	const bool dry_run = m_dry_run != MusicFileCreator::DryRun::NONE;
+	const bool output_set = m_output_dir_set || m_archive_set || m_mount_set || m_engine || dry_run;
+	if (!m_archive_set && !m_mount_set && !m_engine && !dry_run && (!m_update_cache || m_output_dir_set)) {
 		validate_dir("-o, --out", m_output_dir_set, "output dir", m_output_dir.c_str(), W_OK);
 	}
-	if (!m_num_albums_set && m_output_dir_set) {
-		m_num_albums = 1;
+	if (!m_num_albums_set && output_set) {
+		m_num_albums = m_benchmark_set && !m_db_file_set ? BENCHMARK_CDS : 1;
 		m_num_albums_set = true;
 	}
-	if (!m_db_file_set && m_output_dir_set) {
+	if (!m_db_file_set && output_set) {
 		validate_num_cds("-n, --num-albums", m_num_albums_set, "num cds", m_num_albums);
 	}
-	if (m_output_dir_set && validate_file("-t, --template", true, "template music file", m_template_music_file.c_str(), R_OK)) {
-		validate_template_music_file();
+	if (output_set) {
+		for (auto& path : m_template_music_files) {
+			if (validate_file("-t, --template", true, "template music file", path.c_str(), R_OK)) {
+				validate_template_music_file(path);
+			}
+		}
+		validate_format_mix();
 	}
 	if (m_num_threads_set) {
 		validate_num_threads();
@@ -369,6 +1002,173 @@ void Options::validate() {
 	if (m_num_threads < 2 || m_db_file_set) {
 		m_num_threads = 1;
 	}
+	if (!m_engine) {
+		// the threads of an Engine run are limited by its albums
+		m_num_threads = std::min(num_threads(), num_albums());
+	}
+	if (m_num_threads < 2) {
+		m_auto_threads = false;
+	}
+}
+
+void Options::validate_benchmark() {
+	// a dry run is benchmarked without an output dir
+	if (!m_output_dir_set && m_dry_run == MusicFileCreator::DryRun::NONE) {
+		missing("output dir", "-o, --out");
+	}
+	if (m_num_threads_set) {
+		Tracer::cerr("ignoring -c when --benchmark is set, set the threads with --benchmark=threads=<n>/...");
+		m_num_threads_set = false;
+		m_auto_threads = false;
+	}
+	for (auto copy_strategy : m_benchmark_params.copy_strategies) {
+		if (!is_copy_strategy_supported(copy_strategy)) {
+			Tracer::cerr("--benchmark copy (", MusicFileCreator::copy_strategy_name(copy_strategy),
+					") is not supported with --cache-policy=direct or --preallocate, set --benchmark=copy=<strategy>/...");
+			set_valid(false);
+		}
+	}
+}
+
+void Options::validate_engine() {
+	const char* opt = m_daemon_set ? "--daemon" : "libfmf";
+	if (m_output_dir_set || m_archive_set || m_mount_set || m_manifest_set || m_benchmark_set || m_db_file_set
+			|| m_dry_run != MusicFileCreator::DryRun::NONE) {
+		Tracer::cerr(opt, " can't be used with -i, -o, --archive, --mount, --manifest, --dry-run or --benchmark,"
+				" the output is set by each run");
+		set_valid(false);
+	}
+	if (m_auto_threads) {
+		Tracer::cerr(opt, " can't be used with -c auto");
+		set_valid(false);
+	}
+	if (m_daemon_set && m_daemon_socket.empty()) {
+		Tracer::cerr("--daemon must be a socket path");
+		set_valid(false);
+	}
+}
+
+void Options::validate_sink(const char* opt) {
+	if (m_output_dir_set) {
+		Tracer::cerr("can't set both output dir (-o, --out) and ", opt);
+		set_valid(false);
+	}
+	if (m_benchmark_set && m_dry_run == MusicFileCreator::DryRun::NONE) {
+		Tracer::cerr("can't set both --benchmark and ", opt);
+		set_valid(false);
+	}
+	if (m_sparse_set) {
+		Tracer::cerr("can't set both --sparse and ", opt);
+		set_valid(false);
+	}
+	if (m_synthesize_audio) {
+		Tracer::cerr("can't set both --synthesize-audio and ", opt);
+		set_valid(false);
+	}
+	if (m_sync_params.policy != FileSyncer::Policy::NONE) {
+		Tracer::cerr("can't set both --sync and ", opt);
+		set_valid(false);
+	}
+	if (m_preallocate) {
+		Tracer::cerr("can't set both --preallocate and ", opt);
+		set_valid(false);
+	}
+	if (m_cache_policy != MusicFileCreator::CachePolicy::KEEP) {
+		Tracer::cerr("can't set both --cache-policy and ", opt);
+		set_valid(false);
+	}
+}
+
+void Options::validate_archive() {
+	validate_sink("--archive");
+	if (m_archive_file.empty()) {
+		Tracer::cerr("--archive must be a file or ", ArchiveWriter::STDOUT_PATH, " for stdout");
+		set_valid(false);
+	}
+}
+
+void Options::validate_mount() {
+	validate_sink("--mount");
+	if (m_archive_set) {
+		Tracer::cerr("can't set both --archive and --mount");
+		set_valid(false);
+	}
+#ifdef HAVE_FUSE
+	validate_dir("--mount", m_mount_set, "mount dir", m_mount_dir.c_str(), R_OK);
+#else
+	Tracer::cerr("--mount is not supported, ", PACKAGE_NAME, " was built without fuse");
+	set_valid(false);
+#endif
+}
+
+void Options::validate_rates() {
+	if (m_mount_set) {
+		Tracer::cerr("can't set both --mount and --max-files-per-sec or --max-mbps");
+		set_valid(false);
+	}
+	if (m_benchmark_set) {
+		Tracer::cerr("can't set both --benchmark and --max-files-per-sec or --max-mbps");
+		set_valid(false);
+	}
+}
+
+void Options::validate_manifest() {
+	if (!m_manifest_set) {
+		Tracer::cerr("ignoring --manifest-format when --manifest is not set");
+		return;
+	}
+	if (m_manifest_file.empty()) {
+		Tracer::cerr("--manifest must be a file");
+		set_valid(false);
+	}
+	if (m_mount_set) {
+		Tracer::cerr("can't set both --mount and --manifest");
+		set_valid(false);
+	}
+	if (m_benchmark_set) {
+		Tracer::cerr("can't set both --benchmark and --manifest");
+		set_valid(false);
+	}
+}
+
+void Options::validate_preallocate() {
+	if (m_sparse_set) {
+		// the allocated blocks would fill the hole
+		Tracer::cerr("can't set both --sparse and --preallocate");
+		set_valid(false);
+	}
+	if (m_copy_strategy == MusicFileCreator::CopyStrategy::STREAM) {
+		Tracer::cerr("--preallocate is not supported with --copy=stream");
+		set_valid(false);
+	}
+}
+
+void Options::validate_dry_run() {
+	validate_sink("--dry-run");
+	if (m_archive_set || m_mount_set) {
+		Tracer::cerr("can't set --dry-run with --archive or --mount");
+		set_valid(false);
+	}
+}
+
+void Options::validate_make_cddb() {
+	if (m_db_file_set || m_output_dir_set || m_archive_set || m_mount_set || m_manifest_set || m_synthetic_set
+			|| m_update_cache || m_benchmark_set) {
+		Tracer::cerr("--make-cddb can't be used with -i, -o, -u, --archive, --mount, --manifest, --synthetic or --benchmark");
+		set_valid(false);
+	}
+	validate_dir("-d, --cddb", m_db_dir_set, "db dir", m_db_dir.c_str(), W_OK);
+	if (!m_num_albums_set) {
+		m_num_albums = 1;
+		m_num_albums_set = true;
+	}
+	validate_num_cds("-n, --num-albums", m_num_albums_set, "num cds", m_num_albums);
+	if (m_num_threads_set) {
+		validate_num_threads();
+	}
+	if (m_num_threads < 2) {
+		m_num_threads = 1;
+	}
 	m_num_threads = std::min(num_threads(), num_albums());
 }
 
@@ -435,28 +1235,169 @@ void Options::validate_num_cds(const char* opt, bool is_set, const char* name, i
 	set_valid(valid);
 }
 
-void Options::validate_template_music_file() {
-	TagLib::FileRef f(m_template_music_file.c_str());
+void Options::validate_template_music_file(const std::string& path) {
+	TagLib::FileRef f(path.c_str());
 	if (f.isNull()) {
-		Tracer::_err("invalid template music file: ", m_template_music_file);
+		Tracer::_err("invalid template music file: ", path);
 		set_valid(false);
 		return;
 	}
 
 	auto tag = f.tag();
 	if (!tag) {
-		Tracer::_err("error in taglib with template file: ", m_template_music_file);
+		Tracer::_err("error in taglib with template file: ", path);
 		set_valid(false);
 	}
 }
 
 void Options::validate_num_threads() {
+	if (m_auto_threads) {
+		m_num_threads = AUTO_THREADS_PER_CPU * std::max(1U, std::thread::hardware_concurrency());
+		return;
+	}
 	if (m_num_threads < 1 || m_num_threads > MAX_THREADS) {
 		Tracer::cerr("-c, --threads (", m_num_threads, ") must be > 0, <= ", MAX_THREADS);
 		set_valid(false);
 	}
 }
 
+void Options::validate_format_mix() {
+	// the weight of a format is split between its templates
+	std::map<std::string, size_t> format_templates;
+	for (auto& path : m_template_music_files) {
+		format_templates[File(path).extension()]++;
+	}
+	for (auto& fw : m_format_mix) {
+		if (!format_templates.count(fw.first)) {
+			Tracer::cerr("--format-mix format \"", fw.first, "\" has no template music file (-t, --template)");
+			set_valid(false);
+		}
+	}
+	m_template_weights.clear();
+	double total = 0;
+	for (auto& path : m_template_music_files) {
+		const std::string format = File(path).extension();
+		double weight = 1;
+		if (!m_format_mix.empty()) {
+			auto it = m_format_mix.find(format);
+			weight = (it == m_format_mix.end()) ? 0 : it->second / format_templates[format];
+		}
+		m_template_weights.push_back(weight);
+		total += weight;
+	}
+	if (!(total > 0)) {
+		Tracer::cerr("--format-mix picks none of the template music files (-t, --template)");
+		set_valid(false);
+	}
+}
+
+void Options::parse_weights(const char* opt, const char* name, const char* arg, std::map<std::string, double>& weights) {
+	std::istringstream is(arg);
+	std::string item;
+	while (std::getline(is, item, ',')) {
+		auto pos = item.find('=');
+		const char* weight = (pos == std::string::npos) ? "" : item.c_str() + pos + 1;
+		char* end = nullptr;
+		errno = 0;
+		double w = ::strtod(weight, &end);
+		if (pos == 0 || pos == std::string::npos || !*weight || *end || errno || !(w >= 0) || !std::isfinite(w)) {
+			Tracer::cerr(opt, " invalid ", name, " weight \"", item, "\": expected <", name,
+					">=<weight>, weight finite and >= 0");
+			set_valid(false);
+			continue;
+		}
+		weights[item.substr(0, pos)] = w;
+	}
+	if (weights.empty()) {
+		Tracer::cerr(opt, " (", arg, ") sets no ", name, " weights");
+		set_valid(false);
+		return;
+	}
+	double total = 0;
+	for (auto& nw : weights) {
+		total += nw.second;
+	}
+	if (!std::isfinite(total)) {
+		Tracer::cerr(opt, " (", arg, ") ", name, " weights are too large, their sum is not finite");
+		set_valid(false);
+	}
+}
+
+void Options::parse_seed(const char* arg) {
+	char* end = nullptr;
+	errno = 0;
+	unsigned long long seed = ::strtoull(arg, &end, 10);
+	if (!*arg || *end || errno || seed > std::numeric_limits<uint32_t>::max()) {
+		Tracer::cerr("--seed (", arg, ") must be an integer >= 0, <= ", std::numeric_limits<uint32_t>::max());
+		set_valid(false);
+		return;
+	}
+	m_seed = seed;
+	m_seed_set = true;
+}
+
+void Options::parse_rate(const char* opt, const char* arg, double& rate) {
+	char* end = nullptr;
+	errno = 0;
+	rate = ::strtod(arg, &end);
+	if (!*arg || *end || errno || !(rate > 0) || std::isinf(rate)) {
+		Tracer::cerr(opt, " (", arg, ") must be a number > 0");
+		rate = 0;
+		set_valid(false);
+	}
+}
+
+/**
+ * parse <n>[K|M|G]
+ *
+ * @return false if @e value is invalid
+ */
+static bool parse_size(const std::string& value, size_t& size) {
+	char* end = nullptr;
+	errno = 0;
+	unsigned long long n = ::strtoull(value.c_str(), &end, 10);
+	if (value.empty() || !isdigit(value[0]) || errno) {
+		return false;
+	}
+	const char* units = "KMG";
+	const char* unit = *end ? ::strchr(units, ::toupper(*end)) : nullptr;
+	if (unit) {
+		const int shift = 10 * (unit - units + 1);
+		if (n > std::numeric_limits<size_t>::max() >> shift)
+			return false;
+		n <<= shift;
+		end++;
+	}
+	size = n;
+	return !*end && size == n;
+}
+
+void Options::parse_sparse(const char* arg) {
+	std::string value(arg);
+	auto pos = value.find('-');
+	bool valid = parse_size(value.substr(0, pos), m_sparse_size.min);
+	m_sparse_size.max = m_sparse_size.min;
+	if (pos != std::string::npos) {
+		valid = valid && parse_size(value.substr(pos + 1), m_sparse_size.max);
+	}
+	if (!valid || m_sparse_size.min == 0 || m_sparse_size.min > m_sparse_size.max) {
+		Tracer::cerr("--sparse (", arg, ") must be a size <n>[K|M|G] or a range <min>-<max>, > 0");
+		set_valid(false);
+		return;
+	}
+	m_sparse_set = true;
+}
+
+void Options::parse_tracks(const char* opt, const char* arg, size_t& tracks) {
+	int n = str2int(arg);
+	if (n <= 0) {
+		Tracer::cerr(opt, " (", arg, ") must be a number > 0");
+		set_valid(false);
+		return;
+	}
+	tracks = n;
+}
+
 void Options::missing(const char* name, const char* opt) {
 	Tracer::cerr("missing argument ", name, ": ", opt);
 	set_valid(false);
@@ -468,9 +1409,49 @@ std::ostream& operator<<(std::ostream& os, const Options& opts) {
 	os << "is valid: " << opts.m_valid << endl;
 	os << "db dir: " << opts.m_db_dir << endl;
 	os << "db file: " << opts.m_db_file << endl;
+	os << "synthetic: " << opts.m_synthetic_set << " " << opts.m_synthetic_params << endl;
+	os << "make cddb: " << opts.m_make_cddb_set << " " << opts.m_make_cddb_params << endl;
+	os << "benchmark: " << opts.m_benchmark_set << " " << opts.m_benchmark_params << endl;
+	os << "daemon: " << opts.m_daemon_set << " " << opts.m_daemon_socket << endl;
+	os << "engine: " << opts.m_engine << endl;
+	os << "copy: " << MusicFileCreator::copy_strategy_name(opts.m_copy_strategy) << endl;
+	os << "layout: " << MusicFileCreator::layout_name(opts.m_layout) << endl;
+	os << "sync: " << opts.m_sync_params << endl;
+	os << "cache policy: " << MusicFileCreator::cache_policy_name(opts.m_cache_policy) << endl;
+	os << "dry run: " << MusicFileCreator::dry_run_name(opts.m_dry_run) << endl;
+	os << "max files per sec: " << opts.m_max_files_per_sec << endl;
+	os << "max mbps: " << opts.m_max_mbps << endl;
+	os << "cpu affinity: " << opts.m_placement.pin_cpus;
+	for (size_t i = 0; i < opts.m_placement.cpus.size(); i++) {
+		os << (i ? "," : " ") << opts.m_placement.cpus[i];
+	}
+	os << endl;
+	os << "numa: " << opts.m_placement.numa << endl;
+	os << "synthesize audio: " << opts.m_synthesize_audio << endl;
+	os << "preallocate: " << opts.m_preallocate << endl;
+	os << "archive: " << opts.m_archive_set << " " << opts.m_archive_file << endl;
+	os << "mount: " << opts.m_mount_set << " " << opts.m_mount_dir << endl;
+	os << "manifest: " << opts.m_manifest_set << " " << opts.m_manifest_file << " "
+			<< Manifest::format_name(opts.m_manifest_format) << endl;
+	os << "sparse: " << opts.m_sparse_set << " " << opts.m_sparse_size.min << "-" << opts.m_sparse_size.max << endl;
+	os << "seed: " << opts.m_seed << endl;
 	os << "num cds: " << opts.m_num_albums << endl;
-	os << "num threads: " << opts.m_num_threads << endl;
-	os << "template mp3: " << opts.m_template_music_file << endl;
+	os << "num threads: " << opts.m_num_threads << (opts.m_auto_threads ? " auto" : "") << endl;
+	os << "genre weights:";
+	for (auto& gw : opts.m_genre_weights) {
+		os << " " << gw.first << "=" << gw.second;
+	}
+	os << endl;
+	os << "dedup albums: " << opts.m_dedup_albums << endl;
+	os << "album filter:" << opts.m_album_filter << endl;
+	os << "template music files:";
+	for (size_t i = 0; i < opts.m_template_music_files.size(); i++) {
+		os << " " << opts.m_template_music_files[i];
+		if (i < opts.m_template_weights.size()) {
+			os << "=" << opts.m_template_weights[i];
+		}
+	}
+	os << endl;
 	os << "skip empty titles: " << opts.m_skip_empty_titles << endl;
 	os << "verbosity: " << opts.m_verbosity << endl;
 	return os;
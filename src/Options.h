@@ -22,10 +22,22 @@
 #ifndef OPTIONS_H_
 #define OPTIONS_H_
 
+#include "AlbumIndex.h"
+#include "Benchmark.h"
+#include "FileSyncer.h"
+#include "Launcher.h"
+#include "Manifest.h"
+#include "MusicFileCreator.h"
+#include "SyntheticAlbums.h"
+#include "SyntheticCDDB.h"
+
 #include <getopt.h>
 #include <stddef.h>
+#include <cstdint>
+#include <map>
 #include <ostream>
 #include <string>
+#include <vector>
 
 namespace FMF {
 
@@ -37,8 +49,20 @@ public:
 	Options();
 	~Options();
 
+	/**
+	 * parse the command line with getopt, whose state is global: not to be called by several threads at once
+	 *
+	 * @return false if the options are invalid, or the usage or the version was output (is_info_requested())
+	 */
 	bool parse(int argc, char** argv);
 
+	/**
+	 * @return true if parse() output the usage or the version (options -h, --usage, --version) instead of parsing
+	 */
+	bool is_info_requested() const {
+		return m_info_requested;
+	}
+
 	const std::string& db_dir() const {
 		return m_db_dir;
 	}
@@ -55,6 +79,145 @@ public:
 		return m_db_file_set;
 	}
 
+	/**
+	 * @return true if albums are generated in memory (option --synthetic) instead of read from a CDDB
+	 */
+	bool is_synthetic_set() const {
+		return m_synthetic_set;
+	}
+
+	const SyntheticAlbums::Params& synthetic_params() const {
+		return m_synthetic_params;
+	}
+
+	/**
+	 * @return true if a synthetic CDDB is written to db_dir() (option --make-cddb) instead of music files
+	 */
+	bool is_make_cddb_set() const {
+		return m_make_cddb_set;
+	}
+
+	const SyntheticCDDB::Params& make_cddb_params() const {
+		return m_make_cddb_params;
+	}
+
+	/**
+	 * @return true if the creating of music files is benchmarked (option --benchmark)
+	 */
+	bool is_benchmark_set() const {
+		return m_benchmark_set;
+	}
+
+	const Benchmark::Params& benchmark_params() const {
+		return m_benchmark_params;
+	}
+
+	/**
+	 * @return true if jobs are run from the socket daemon_socket() (option --daemon)
+	 */
+	bool is_daemon_set() const {
+		return m_daemon_set;
+	}
+
+	const std::string& daemon_socket() const {
+		return m_daemon_socket;
+	}
+
+	/**
+	 * @return true if the music files are extended to sparse_size() with a hole (option --sparse)
+	 */
+	bool is_sparse_set() const {
+		return m_sparse_set;
+	}
+
+	/**
+	 * @return range of the apparent size of sparse music files in bytes
+	 */
+	const SyntheticAlbums::Range& sparse_size() const {
+		return m_sparse_size;
+	}
+
+	/**
+	 * @return true if silent audio of the track duration is written instead of the template audio (option --synthesize-audio)
+	 */
+	bool synthesize_audio() const {
+		return m_synthesize_audio;
+	}
+
+	/**
+	 * @return how the template is copied, set by option --copy
+	 */
+	MusicFileCreator::CopyStrategy copy_strategy() const {
+		return m_copy_strategy;
+	}
+
+	/**
+	 * @return the dirs of the music files, set by option --layout
+	 */
+	MusicFileCreator::Layout layout() const {
+		return m_layout;
+	}
+
+	/**
+	 * @return placement of the threads, set by options --cpu-affinity and --numa
+	 */
+	const Launcher::Placement& placement() const {
+		return m_placement;
+	}
+
+	/**
+	 * @return max number of music files created per second (option --max-files-per-sec), 0 if not limited
+	 */
+	double max_files_per_sec() const {
+		return m_max_files_per_sec;
+	}
+
+	/**
+	 * @return max MB (10^6 bytes) of music files written per second (option --max-mbps), 0 if not limited
+	 */
+	double max_mbps() const {
+		return m_max_mbps;
+	}
+
+	/**
+	 * @return how the music files are written with respect to the page cache, set by option --cache-policy
+	 */
+	MusicFileCreator::CachePolicy cache_policy() const {
+		return m_cache_policy;
+	}
+
+	/**
+	 * @return how far the music files are created without writing them, set by option --dry-run
+	 */
+	MusicFileCreator::DryRun dry_run() const {
+		return m_dry_run;
+	}
+
+	/**
+	 * @return how the created music files are synced to disk, set by option --sync
+	 */
+	const FileSyncer::Params& sync_params() const {
+		return m_sync_params;
+	}
+
+	/**
+	 * @return true if the disk space of the music files is allocated before writing them (option --preallocate)
+	 */
+	bool preallocate() const {
+		return m_preallocate;
+	}
+
+	/**
+	 * @return the seed set by option --seed, or a random seed if not set (a fixed seed with --benchmark)
+	 */
+	uint32_t seed() const {
+		return m_seed;
+	}
+
+	bool is_seed_set() const {
+		return m_seed_set;
+	}
+
 	bool is_num_albums_set() const {
 		return m_num_albums_set;
 	}
@@ -72,10 +235,60 @@ public:
 	}
 
 	/**
-	 * @return the template music file set by option -t
+	 * @return true if the music files are streamed to a tar archive instead of the output dir (option --archive)
 	 */
-	const std::string& template_music_file() const {
-		return m_template_music_file;
+	bool is_archive_set() const {
+		return m_archive_set;
+	}
+
+	/**
+	 * @return path of the tar archive, ArchiveWriter::STDOUT_PATH for stdout
+	 */
+	const std::string& archive_file() const {
+		return m_archive_file;
+	}
+
+	/**
+	 * @return true if the music files are served from memory with fuse instead of the output dir (option --mount)
+	 */
+	bool is_mount_set() const {
+		return m_mount_set;
+	}
+
+	const std::string& mount_dir() const {
+		return m_mount_dir;
+	}
+
+	/**
+	 * @return true if a manifest of the created music files is written (option --manifest)
+	 */
+	bool is_manifest_set() const {
+		return m_manifest_set;
+	}
+
+	const std::string& manifest_file() const {
+		return m_manifest_file;
+	}
+
+	/**
+	 * @return format of the manifest, set by option --manifest-format
+	 */
+	Manifest::Format manifest_format() const {
+		return m_manifest_format;
+	}
+
+	/**
+	 * @return the template music files set by option -t, the default template if not set
+	 */
+	const std::vector<std::string>& template_music_files() const {
+		return m_template_music_files;
+	}
+
+	/**
+	 * @return weight of each of template_music_files() for picking the template of a track, by option --format-mix
+	 */
+	const std::vector<double>& template_weights() const {
+		return m_template_weights;
 	}
 
 	size_t verbosity() const {
@@ -94,25 +307,128 @@ public:
 		return m_num_threads;
 	}
 
+	/**
+	 * @return true if the number of active threads of num_threads() is tuned at run time (option -c auto)
+	 */
+	bool is_auto_threads() const {
+		return m_auto_threads;
+	}
+
 	bool only_update_cache() const {
-		return update_cache() && !is_output_dir_set();
+		return update_cache() && !is_output_dir_set() && !is_archive_set() && !is_mount_set() && !is_daemon_set()
+				&& dry_run() == MusicFileCreator::DryRun::NONE;
+	}
+
+	/**
+	 * @return genre name to weight set by option --genre-weights, empty if not set
+	 */
+	const std::map<std::string, double>& genre_weights() const {
+		return m_genre_weights;
+	}
+
+	/**
+	 * @return true if albums of the same artist and title are picked only once (option --dedup-albums)
+	 */
+	bool dedup_albums() const {
+		return m_dedup_albums;
+	}
+
+	/**
+	 * @return the albums to pick, set by options --year, --min-tracks, --max-tracks, --artist-initial and --dgenre
+	 */
+	const AlbumIndex::Filter& album_filter() const {
+		return m_album_filter;
+	}
+
+	//-------------------------------------------------------------------------
+	// set for each run of an Engine or a Benchmark, instead of from the command line. the setters that check their
+	// value return false and leave the option unchanged if it is invalid
+	//-------------------------------------------------------------------------
+	/**
+	 * check the options as the options of an Engine in parse(), which must not be called yet
+	 */
+	void set_engine() {
+		m_engine = true;
+	}
+
+	/**
+	 * @param output_dir	a writable dir, or empty if the files are added to a sink
+	 */
+	bool set_output_dir(const std::string& output_dir);
+
+	/**
+	 * @param num_albums	> 0, <= MAX_CDS
+	 */
+	bool set_num_albums(size_t num_albums);
+
+	void set_seed(uint32_t seed) {
+		m_seed = seed;
+	}
+
+	void set_layout(MusicFileCreator::Layout layout) {
+		m_layout = layout;
+	}
+
+	/**
+	 * @param num_threads	> 0, <= MAX_THREADS
+	 */
+	bool set_num_threads(size_t num_threads);
+
+	/**
+	 * @return false if @e copy_strategy is not supported with --cache-policy or --preallocate
+	 */
+	bool set_copy_strategy(MusicFileCreator::CopyStrategy copy_strategy);
+
+	void set_update_cache(bool update_cache) {
+		m_update_cache = update_cache;
 	}
 
 	friend std::ostream& operator<<(std::ostream& os, const Options& opts);
 
+	/// max albums, of -n and of the runs of an Engine
+	static const int MAX_CDS;
+	/// max threads, of -c and of the runs of a Benchmark
+	static const int MAX_THREADS;
+
 private:
 	std::string m_db_dir;
 	std::string m_output_dir;
+	std::string m_archive_file;
+	std::string m_mount_dir;
+	std::string m_manifest_file;
+	Manifest::Format m_manifest_format;
 	size_t m_num_albums;
 	std::string m_db_file;
-	std::string m_template_music_file;
+	std::vector<std::string> m_template_music_files;
 	bool m_skip_empty_titles;
 	size_t m_verbosity;
 	bool m_update_cache;
 	size_t m_num_threads;
+	bool m_auto_threads;
+	std::map<std::string, double> m_genre_weights;
+	bool m_dedup_albums;
+	AlbumIndex::Filter m_album_filter;
+	std::map<std::string, double> m_format_mix;
+	std::vector<double> m_template_weights;
+	SyntheticAlbums::Params m_synthetic_params;
+	SyntheticCDDB::Params m_make_cddb_params;
+	Benchmark::Params m_benchmark_params;
+	std::string m_daemon_socket;
+	MusicFileCreator::CopyStrategy m_copy_strategy;
+	MusicFileCreator::Layout m_layout;
+	FileSyncer::Params m_sync_params;
+	MusicFileCreator::CachePolicy m_cache_policy;
+	MusicFileCreator::DryRun m_dry_run;
+	double m_max_files_per_sec;
+	double m_max_mbps;
+	Launcher::Placement m_placement;
+	SyntheticAlbums::Range m_sparse_size;
+	bool m_synthesize_audio;
+	bool m_preallocate;
+	uint32_t m_seed;
 
-	static const int MAX_CDS;
-	static const int MAX_THREADS;
+	static const int BENCHMARK_CDS;
+	static const int AUTO_THREADS_PER_CPU;
 	static const char* DEFAULT_TEMPLATE;
 
 	static struct option s_options[];
@@ -120,8 +436,34 @@ private:
 	void validate_dir(const char* opt, bool is_set, const char* name, const char* var, int perm);
 	bool validate_file(const char* opt, bool is_set, const char* name, const char* var, int perm);
 	void validate_num_cds(const char* opt, bool is_set, const char* name, int num);
-	void validate_template_music_file();
+	void validate_template_music_file(const std::string& path);
+	void validate_format_mix();
 	void validate_num_threads();
+	/**
+	 * @return false if @e copy_strategy is not supported with --cache-policy or --preallocate
+	 */
+	bool is_copy_strategy_supported(MusicFileCreator::CopyStrategy copy_strategy) const;
+	void parse_weights(const char* opt, const char* name, const char* arg, std::map<std::string, double>& weights);
+	void parse_seed(const char* arg);
+	void parse_sparse(const char* arg);
+	void parse_tracks(const char* opt, const char* arg, size_t& tracks);
+	void parse_rate(const char* opt, const char* arg, double& rate);
+	void validate_make_cddb();
+	void validate_benchmark();
+	/**
+	 * check the options of an Engine, whose output is set by each run
+	 */
+	void validate_engine();
+	/**
+	 * check that the options of writing to the output dir are not set with @e opt, which replaces it
+	 */
+	void validate_sink(const char* opt);
+	void validate_archive();
+	void validate_mount();
+	void validate_manifest();
+	void validate_rates();
+	void validate_preallocate();
+	void validate_dry_run();
 	void set_valid(bool valid) {
 		m_valid = m_valid && valid;
 	}
@@ -130,12 +472,25 @@ private:
 	void usage(const char* prog_name, std::ostream& os);
 
 	bool m_valid;
+	bool m_info_requested;
 	bool m_output_dir_set;
+	bool m_archive_set;
+	bool m_mount_set;
+	bool m_manifest_set;
+	bool m_manifest_format_set;
 	bool m_db_dir_set;
 	bool m_num_albums_set;
 	bool m_db_file_set;
 	bool m_template_music_file_set;
 	bool m_num_threads_set;
+	bool m_synthetic_set;
+	bool m_make_cddb_set;
+	bool m_benchmark_set;
+	bool m_daemon_set;
+	/// the options of an Engine, set by Engine and option --daemon
+	bool m_engine;
+	bool m_sparse_set;
+	bool m_seed_set;
 };
 
 } /* namespace fmf */
@@ -0,0 +1,65 @@
+/*
+ * PathFilter.cpp
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#include "PathFilter.h"
+
+namespace FMF {
+
+/*static*/const size_t PathFilter::SLOTS;
+/*static*/const size_t PathFilter::PROBES;
+
+/**
+ * FNV-1a 64 bit hash, never 0, the free slot
+ */
+static uint64_t path_hash(const std::string& path) {
+	uint64_t hash = 14695981039346656037ULL;
+	for (unsigned char c : path) {
+		hash = (hash ^ c) * 1099511628211ULL;
+	}
+	return hash ? hash : 1;
+}
+
+PathFilter::PathFilter() :
+		m_slots(new std::atomic<uint64_t>[SLOTS]) {
+	clear();
+}
+
+bool PathFilter::insert(const std::string& path) {
+	const uint64_t hash = path_hash(path);
+	for (size_t i = 0; i < PROBES; i++) {
+		std::atomic<uint64_t>& slot = m_slots[(hash + i) & (SLOTS - 1)];
+		uint64_t expected = 0;
+		if (slot.compare_exchange_strong(expected, hash))
+			return true;
+		if (expected == hash)
+			return false;
+	}
+	// the table is full around hash
+	return true;
+}
+
+void PathFilter::clear() {
+	for (size_t i = 0; i < SLOTS; i++) {
+		m_slots[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+} /* namespace FMF */
@@ -0,0 +1,69 @@
+/*
+ * PathFilter.h
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#ifndef PATHFILTER_H_
+#define PATHFILTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+
+namespace FMF {
+
+/**
+ * the 64 bit hashes of the paths added to a sink, in a table of a fixed size, e.g. for skipping the tracks of an
+ * album picked again in a multi million file --archive.
+ *
+ * insert() is called by all the creating threads at once, without a lock. a path whose PROBES slots are all taken
+ * is not remembered, so a full table lets a path inserted again through but never skips a new path, unless the
+ * hashes of two paths are equal.
+ */
+class PathFilter {
+public:
+	/// size of the table, of 8 bytes each
+	static const size_t SLOTS = 1 << 20;
+	/// slots tried from the slot of the hash of a path
+	static const size_t PROBES = 8;
+
+	PathFilter();
+
+	/**
+	 * @return false if @e path was inserted before
+	 */
+	bool insert(const std::string& path);
+
+	/**
+	 * forget the inserted paths, not to be called while paths are inserted
+	 */
+	void clear();
+
+private:
+	PathFilter(const PathFilter&) = delete;
+	PathFilter& operator=(const PathFilter&) = delete;
+
+	/// the hashes of the inserted paths, 0 for a free slot
+	std::unique_ptr<std::atomic<uint64_t>[]> m_slots;
+};
+
+} /* namespace FMF */
+#endif /* PATHFILTER_H_ */
@@ -0,0 +1,69 @@
+/*
+ * RateLimiter.cpp
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#include "RateLimiter.h"
+#include "Context.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace FMF {
+
+/*static*/const int64_t RateLimiter::BURST_NS;
+/*static*/const int64_t RateLimiter::MAX_SLEEP_NS;
+
+RateLimiter::RateLimiter(double rate) :
+		m_rate(rate), m_ns_per_unit(1e9 / rate), m_epoch(std::chrono::steady_clock::now()), m_next_ns(0), m_units(0), m_wait_ns(
+				0) {
+}
+
+RateLimiter::~RateLimiter() {
+}
+
+int64_t RateLimiter::now_ns() const {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_epoch).count();
+}
+
+void RateLimiter::acquire(uint64_t units) {
+	const int64_t cost = static_cast<int64_t>(units * m_ns_per_unit + 0.5);
+	int64_t now = now_ns();
+	int64_t next = m_next_ns.load();
+	int64_t start;
+	do {
+		start = std::max(next, now - BURST_NS);
+	} while (!m_next_ns.compare_exchange_weak(next, start + cost));
+	m_units += units;
+
+	if (start <= now)
+		return;
+	m_wait_ns += start - now;
+	while (start > now && !Context::stopped()) {
+		std::this_thread::sleep_for(std::chrono::nanoseconds(std::min(start - now, MAX_SLEEP_NS)));
+		now = now_ns();
+	}
+}
+
+double RateLimiter::achieved_rate() const {
+	const int64_t elapsed = now_ns();
+	return elapsed > 0 ? m_units * 1e9 / elapsed : 0;
+}
+
+} /* namespace FMF */
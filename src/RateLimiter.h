@@ -0,0 +1,88 @@
+/*
+ * RateLimiter.h
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#ifndef RATELIMITER_H_
+#define RATELIMITER_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+
+namespace FMF {
+
+/**
+ * token bucket shared by all the threads, set by options --max-files-per-sec and --max-mbps.
+ *
+ * implemented as a virtual schedule (GCRA): m_next_ns is the time the next unit is due, each acquire() moves it by
+ * the cost of its units with a compare and swap, and waits until its own start. no lock is taken and the rate is
+ * exact at any rate, up to a burst of BURST_NS after an idle period or a late wake up.
+ */
+class RateLimiter {
+public:
+	/**
+	 * @param rate	units per second
+	 */
+	RateLimiter(double rate);
+	~RateLimiter();
+
+	/**
+	 * take @e units, waiting until the rate allows them. returns early when Context::stopped()
+	 */
+	void acquire(uint64_t units);
+
+	double rate() const {
+		return m_rate;
+	}
+
+	/**
+	 * @return units per second taken since construction
+	 */
+	double achieved_rate() const;
+
+	/**
+	 * @return the time waited by all the threads
+	 */
+	std::chrono::nanoseconds wait_time() const {
+		return std::chrono::nanoseconds(m_wait_ns);
+	}
+
+private:
+	RateLimiter(const RateLimiter&) = delete;
+	RateLimiter& operator=(const RateLimiter&) = delete;
+
+	int64_t now_ns() const;
+
+	/// credit of unused time that is kept, so late wake ups do not lower the rate
+	static const int64_t BURST_NS = 100000000;
+	/// longest sleep between checks of Context::stopped()
+	static const int64_t MAX_SLEEP_NS = 100000000;
+
+	const double m_rate;
+	const double m_ns_per_unit;
+	const std::chrono::steady_clock::time_point m_epoch;
+	/// time the next unit is due, from m_epoch
+	std::atomic<int64_t> m_next_ns;
+	std::atomic<uint64_t> m_units;
+	std::atomic<uint64_t> m_wait_ns;
+};
+
+} /* namespace FMF */
+#endif /* RATELIMITER_H_ */
@@ -0,0 +1,237 @@
+/*
+ * SyntheticAlbums.cpp
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#include "SyntheticAlbums.h"
+#include "Tracer.h"
+
+#include <stdio.h>
+#include <cstdlib>
+#include <ostream>
+#include <sstream>
+
+namespace FMF {
+
+typedef std::uniform_int_distribution<size_t> SizeDistribution;
+
+/**
+ * code point ranges of the letters of SyntheticAlbums::Script.
+ * the ranges are covered by the legacy charsets of each script.
+ */
+static const struct CodePoints {
+	uint32_t first;
+	uint32_t last;
+} s_scripts[] = {
+	{ 'a', 'z' },       // ascii
+	{ 0x00C0, 0x00FF }, // latin-1 supplement letters
+	{ 0x03B1, 0x03C9 }, // greek
+	{ 0x0410, 0x044F }, // cyrillic
+	{ 0x05D0, 0x05EA }, // hebrew
+	{ 0x3041, 0x3093 }, // hiragana
+	{ 0x4E00, 0x9FA5 }, // cjk unified ideographs
+};
+
+static const char* s_genres[] = { "Blues", "Classical", "Country", "Data", "Folk", "Jazz", "Misc", "Newage", "Reggae",
+									"Rock", "Soundtrack" };
+
+static void append_utf8(std::string& str, uint32_t cp) {
+	if (cp < 0x80) {
+		str += static_cast<char>(cp);
+	}
+	else if (cp < 0x800) {
+		str += static_cast<char>(0xC0 | (cp >> 6));
+		str += static_cast<char>(0x80 | (cp & 0x3F));
+	}
+	else {
+		str += static_cast<char>(0xE0 | (cp >> 12));
+		str += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+		str += static_cast<char>(0x80 | (cp & 0x3F));
+	}
+}
+
+//-----------------------------------------------------------------------------
+// SyntheticAlbums::Range
+//-----------------------------------------------------------------------------
+bool SyntheticAlbums::Range::parse(const std::string& value) {
+	unsigned long lo, hi;
+	int n = 0;
+	if (2 == ::sscanf(value.c_str(), "%lu-%lu%n", &lo, &hi, &n) && n == (int) value.size()) {
+		min = lo;
+		max = hi;
+	}
+	else if (1 == ::sscanf(value.c_str(), "%lu%n", &lo, &n) && n == (int) value.size()) {
+		min = max = lo;
+	}
+	else {
+		return false;
+	}
+	return min > 0 && min <= max;
+}
+
+//-----------------------------------------------------------------------------
+// SyntheticAlbums::Params
+//-----------------------------------------------------------------------------
+SyntheticAlbums::Params::Params() :
+		albums_per_artist { 1, 5 }, tracks_per_album { 8, 16 }, name_length { 4, 30 }, unicode_percent(10) {
+}
+
+bool SyntheticAlbums::Params::parse(const std::string& spec) {
+	bool valid = true;
+	std::istringstream is(spec);
+	std::string item;
+	while (std::getline(is, item, ',')) {
+		auto pos = item.find('=');
+		std::string key = item.substr(0, pos);
+		std::string value = (pos == std::string::npos) ? "" : item.substr(pos + 1);
+		bool ok = false;
+		if (key == "albums-per-artist") {
+			ok = albums_per_artist.parse(value);
+		}
+		else if (key == "tracks") {
+			ok = tracks_per_album.parse(value);
+		}
+		else if (key == "name-length") {
+			ok = name_length.parse(value);
+		}
+		else if (key == "unicode") {
+			unsigned long percent;
+			int n = 0;
+			ok = 1 == ::sscanf(value.c_str(), "%lu%n", &percent, &n) && n == (int) value.size() && percent <= 100;
+			if (ok) {
+				unicode_percent = percent;
+			}
+		}
+		if (!ok) {
+			Tracer::cerr("--synthetic invalid parameter \"", item, "\"");
+			valid = false;
+		}
+	}
+	return valid;
+}
+
+std::ostream& operator<<(std::ostream& os, const SyntheticAlbums::Params& params) {
+	os << "albums-per-artist=" << params.albums_per_artist.min << '-' << params.albums_per_artist.max;
+	os << ",tracks=" << params.tracks_per_album.min << '-' << params.tracks_per_album.max;
+	os << ",name-length=" << params.name_length.min << '-' << params.name_length.max;
+	os << ",unicode=" << params.unicode_percent;
+	return os;
+}
+
+//-----------------------------------------------------------------------------
+// SyntheticAlbums
+//-----------------------------------------------------------------------------
+SyntheticAlbums::SyntheticAlbums(const Params& params, uint32_t seed) :
+		m_params(params), m_seed(seed), m_prng(), m_artist(0), m_artist_albums(0), m_album(0) {
+	Tracer::_debug("seeding synthetic albums with: ", m_seed);
+	m_prng.seed(m_seed);
+}
+
+SyntheticAlbums::~SyntheticAlbums() {
+}
+
+std::string SyntheticAlbums::next_album() {
+	if (m_album >= m_artist_albums) {
+		m_artist++;
+		m_album = 0;
+		m_artist_albums = SizeDistribution(m_params.albums_per_artist.min, m_params.albums_per_artist.max)(m_prng);
+	}
+	std::ostringstream os;
+	os << s_album_id_prefix << m_artist << '.' << m_album++;
+	return os.str();
+}
+
+std::vector<TrackInfo> SyntheticAlbums::tracks(const std::string& album_id) const {
+	std::vector<TrackInfo> tracks;
+	std::string format = std::string(s_album_id_prefix) + "%lu.%lu%n";
+	unsigned long artist, album;
+	int n = 0;
+	if (2 != ::sscanf(album_id.c_str(), format.c_str(), &artist, &album, &n) || n != (int) album_id.size()) {
+		Tracer::_err("invalid synthetic album id: ", album_id);
+		return tracks;
+	}
+
+	// same artist name for all the albums of the artist
+	std::seed_seq artist_seed { m_seed, static_cast<uint32_t>(artist), 0U };
+	Generator artist_rand(artist_seed);
+	const std::string artist_name = make_name(artist_rand);
+
+	std::seed_seq album_seed { m_seed, static_cast<uint32_t>(artist), static_cast<uint32_t>(album + 1) };
+	Generator rand(album_seed);
+	const std::string album_name = make_name(rand);
+	const size_t year = SizeDistribution(1950, 2014)(rand);
+	const std::string genre = s_genres[SizeDistribution(0, sizeof(s_genres) / sizeof(s_genres[0]) - 1)(rand)];
+	const size_t num_tracks = SizeDistribution(m_params.tracks_per_album.min, m_params.tracks_per_album.max)(rand);
+
+	tracks.reserve(num_tracks);
+	for (size_t track_num = 1; track_num <= num_tracks; track_num++) {
+		TrackInfo ti;
+		ti.set_db_file(album_id);
+		ti.set_album_artist(artist_name);
+		ti.set_artist(artist_name);
+		ti.set_album(album_name);
+		ti.set_title(make_name(rand));
+		ti.set_genre(genre);
+		ti.set_year(year);
+		ti.set_track_num(track_num);
+		ti.set_tracks_total(num_tracks);
+		ti.set_duration_ms(SizeDistribution(60, 600)(rand) * 1000);
+		tracks.push_back(ti);
+	}
+	return tracks;
+}
+
+std::string SyntheticAlbums::make_name(Generator& rand) const {
+	Script script = Script::ASCII;
+	if (SizeDistribution(0, 99)(rand) < m_params.unicode_percent) {
+		script = static_cast<Script>(SizeDistribution(1, sizeof(s_scripts) / sizeof(s_scripts[0]) - 1)(rand));
+	}
+	return make_name(rand, m_params.name_length, script);
+}
+
+/*static*/std::string SyntheticAlbums::make_name(Generator& rand, const Range& length, Script script) {
+	const size_t len = SizeDistribution(length.min, length.max)(rand);
+	const CodePoints& letters = s_scripts[static_cast<size_t>(script)];
+
+	std::string name;
+	name.reserve(len * 3);
+	SizeDistribution word_len_dist(2, 9);
+	SizeDistribution ascii_dist(0, 25);
+	SizeDistribution letter_dist(letters.first, letters.last);
+	size_t word_len = word_len_dist(rand);
+	for (size_t i = 0, w = 0; i < len; i++) {
+		if (w == word_len && i + 1 < len) {
+			name += ' ';
+			w = 0;
+			word_len = word_len_dist(rand);
+			continue;
+		}
+		// latin-1 letters are mixed with ascii letters as in real names
+		if (script != Script::ASCII && (script != Script::LATIN1 || ascii_dist(rand) < 8)) {
+			append_utf8(name, letter_dist(rand));
+		}
+		else {
+			name += static_cast<char>((w ? 'a' : 'A') + ascii_dist(rand));
+		}
+		w++;
+	}
+	return name;
+}
+
+} /* namespace FMF */
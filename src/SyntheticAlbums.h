@@ -0,0 +1,127 @@
+/*
+ * SyntheticAlbums.h
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#ifndef SYNTHETICALBUMS_H_
+#define SYNTHETICALBUMS_H_
+
+#include "TrackInfo.h"
+
+#include <stddef.h>
+#include <cstdint>
+#include <iosfwd>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace FMF {
+
+/**
+ * generates albums track info in memory, used instead of a CDDB.
+ *
+ * albums are handed out in order by next_album() as ids. the tracks of an album are a function of
+ * the seed and the album id only, so they don't depend on which thread generates them.
+ */
+class SyntheticAlbums {
+public:
+	/**
+	 * inclusive range of values
+	 */
+	struct Range {
+		/**
+		 * parse <n> or <min>-<max>
+		 *
+		 * @return false if @e value is invalid, 0 or min > max
+		 */
+		bool parse(const std::string& value);
+
+		size_t min;
+		size_t max;
+	};
+
+	/**
+	 * script of generated names
+	 */
+	enum class Script {
+		ASCII, LATIN1, GREEK, CYRILLIC, HEBREW, HIRAGANA, CJK
+	};
+
+	typedef std::default_random_engine Generator;
+
+	/**
+	 * generation parameters, set by option --synthetic=<key>=<value>,...
+	 */
+	struct Params {
+		Params();
+
+		/**
+		 * parse a comma separated list of key=value or key=min-max
+		 *
+		 * @return false if @e spec is invalid
+		 */
+		bool parse(const std::string& spec);
+
+		Range albums_per_artist;
+		Range tracks_per_album;
+		Range name_length;
+		/// percent of names written in a non ascii script
+		size_t unicode_percent;
+	};
+
+	SyntheticAlbums(const Params& params, uint32_t seed);
+	~SyntheticAlbums();
+
+	/**
+	 * get the id of the next album. not thread safe.
+	 */
+	std::string next_album();
+
+	/**
+	 * generate the tracks of album @e album_id returned by next_album(). thread safe.
+	 *
+	 * @return empty if @e album_id is invalid
+	 */
+	std::vector<TrackInfo> tracks(const std::string& album_id) const;
+
+	/**
+	 * generate a name of random words
+	 *
+	 * @param length  range of the name length in characters
+	 * @param script  script of the letters. latin-1 letters are mixed with ascii ones.
+	 */
+	static std::string make_name(Generator& rand, const Range& length, Script script);
+
+	friend std::ostream& operator<<(std::ostream& os, const Params& params);
+
+private:
+	std::string make_name(Generator& rand) const;
+
+	static constexpr const char* s_album_id_prefix = "synthetic:";
+
+	const Params m_params;
+	uint32_t m_seed;
+	Generator m_prng;
+	size_t m_artist;
+	size_t m_artist_albums;
+	size_t m_album;
+};
+
+} /* namespace FMF */
+#endif /* SYNTHETICALBUMS_H_ */
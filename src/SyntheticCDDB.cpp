@@ -0,0 +1,403 @@
+/*
+ * SyntheticCDDB.cpp
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#include "SyntheticCDDB.h"
+#include "config.h"
+#include "Context.h"
+#include "Dir.h"
+#include "Launcher.h"
+#include "Tracer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <iconv.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <functional>
+#include <ostream>
+#include <sstream>
+
+namespace FMF {
+
+typedef std::uniform_int_distribution<size_t> SizeDistribution;
+typedef SyntheticAlbums::Script Script;
+
+/**
+ * the charsets a cddb file can be written in, with the script of its names
+ */
+static const struct {
+	const char* name;
+	Script script;
+	bool any_script;
+} s_charsets[] = {
+	{ "ascii", Script::ASCII, false },
+	{ "utf-8", Script::ASCII, true },
+	{ "iso-8859-1", Script::LATIN1, false },
+	{ "windows-1252", Script::LATIN1, false },
+	{ "iso-8859-7", Script::GREEK, false },
+	{ "koi8-r", Script::CYRILLIC, false },
+	{ "windows-1251", Script::CYRILLIC, false },
+	{ "iso-8859-8", Script::HEBREW, false },
+	{ "shift_jis", Script::HIRAGANA, false },
+	{ "euc-jp", Script::HIRAGANA, false },
+	{ "gb18030", Script::CJK, false },
+};
+
+static const size_t NUM_CHARSETS = sizeof(s_charsets) / sizeof(s_charsets[0]);
+
+static size_t find_charset(const std::string& name) {
+	for (size_t i = 0; i < NUM_CHARSETS; i++) {
+		if (name == s_charsets[i].name)
+			return i;
+	}
+	return NUM_CHARSETS;
+}
+
+/**
+ * the freedb genre dirs
+ */
+static const char* s_genres[] = { "blues", "classical", "country", "data", "folk", "jazz", "misc", "newage", "reggae",
+									"rock", "soundtrack" };
+
+static const size_t NUM_GENRES = sizeof(s_genres) / sizeof(s_genres[0]);
+
+/**
+ * murmur3 finalizer. a bijection, so distinct file numbers get distinct disc ids.
+ */
+static uint32_t mix32(uint32_t h) {
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+/**
+ * converts utf-8 strings to the charsets of s_charsets using iconv lib.
+ */
+class SyntheticCDDB::Encoder {
+public:
+	Encoder() :
+			m_handles() {
+		for (auto& charset : s_charsets) {
+			m_handles.push_back(charset.any_script ? (::iconv_t) -1 : ::iconv_open(charset.name, "UTF-8"));
+		}
+	}
+
+	~Encoder() {
+		for (auto handle : m_handles) {
+			if ((::iconv_t) -1 != handle)
+				::iconv_close(handle);
+		}
+	}
+
+	Encoder(const Encoder&) = delete;
+	Encoder& operator=(const Encoder&) = delete;
+
+	/**
+	 * convert @e str to charset s_charsets[@e charset]
+	 *
+	 * @return false if conversion failed
+	 */
+	bool encode(size_t charset, std::string& str) {
+		if (s_charsets[charset].any_script)
+			return true;
+		::iconv_t handle = m_handles[charset];
+		if ((::iconv_t) -1 == handle)
+			return false;
+		std::string out(str.size() * 2 + 16, '\0');
+		char* in_buf = &str[0];
+		size_t in_remain = str.size();
+		char* out_buf = &out[0];
+		size_t out_remain = out.size();
+		::iconv(handle, nullptr, nullptr, nullptr, nullptr);
+		if ((size_t) -1 == ::iconv(handle, &in_buf, &in_remain, &out_buf, &out_remain))
+			return false;
+		out.resize(out.size() - out_remain);
+		str = std::move(out);
+		return true;
+	}
+
+private:
+	std::vector< ::iconv_t> m_handles;
+};
+
+//-----------------------------------------------------------------------------
+// SyntheticCDDB::Params
+//-----------------------------------------------------------------------------
+SyntheticCDDB::Params::Params() :
+		charsets { { "utf-8", 40 }, { "ascii", 30 }, { "iso-8859-1", 15 }, { "windows-1251", 5 }, { "shift_jis", 5 }, {
+				"gb18030", 5 } }, tracks { 1, 20 }, size { 512, 4096 }, name_length { 4, 30 }, malformed_percent(1) {
+}
+
+bool SyntheticCDDB::Params::parse(const std::string& spec) {
+	bool valid = true;
+	std::istringstream is(spec);
+	std::string item;
+	while (std::getline(is, item, ',')) {
+		auto pos = item.find('=');
+		std::string key = item.substr(0, pos);
+		std::string value = (pos == std::string::npos) ? "" : item.substr(pos + 1);
+		bool ok = false;
+		if (key == "charsets") {
+			// <charset>:<weight>/<charset>:<weight>...
+			charsets.clear();
+			std::istringstream cs(value);
+			std::string charset;
+			ok = true;
+			while (ok && std::getline(cs, charset, '/')) {
+				auto wpos = charset.find(':');
+				unsigned long weight = 1;
+				int n = 0;
+				std::string name = charset.substr(0, wpos);
+				if (wpos != std::string::npos) {
+					std::string w = charset.substr(wpos + 1);
+					ok = 1 == ::sscanf(w.c_str(), "%lu%n", &weight, &n) && n == (int) w.size();
+				}
+				if (ok && find_charset(name) == NUM_CHARSETS) {
+					Tracer::cerr("--make-cddb unsupported charset \"", name, "\"");
+					ok = false;
+				}
+				charsets.push_back( { name, weight });
+			}
+			ok = ok && charsets.end() != std::find_if(charsets.begin(), charsets.end(), [](const Charset& c) {return c.weight > 0;});
+		}
+		else if (key == "tracks") {
+			ok = tracks.parse(value) && tracks.max < 100;
+		}
+		else if (key == "size") {
+			ok = size.parse(value);
+		}
+		else if (key == "name-length") {
+			ok = name_length.parse(value);
+		}
+		else if (key == "malformed") {
+			unsigned long percent;
+			int n = 0;
+			ok = 1 == ::sscanf(value.c_str(), "%lu%n", &percent, &n) && n == (int) value.size() && percent <= 100;
+			if (ok) {
+				malformed_percent = percent;
+			}
+		}
+		if (!ok) {
+			Tracer::cerr("--make-cddb invalid parameter \"", item, "\"");
+			valid = false;
+		}
+	}
+	return valid;
+}
+
+std::ostream& operator<<(std::ostream& os, const SyntheticCDDB::Params& params) {
+	os << "charsets=";
+	for (auto& charset : params.charsets) {
+		os << (&charset == &params.charsets[0] ? "" : "/") << charset.name << ':' << charset.weight;
+	}
+	os << ",tracks=" << params.tracks.min << '-' << params.tracks.max;
+	os << ",size=" << params.size.min << '-' << params.size.max;
+	os << ",name-length=" << params.name_length.min << '-' << params.name_length.max;
+	os << ",malformed=" << params.malformed_percent;
+	return os;
+}
+
+//-----------------------------------------------------------------------------
+// SyntheticCDDB
+//-----------------------------------------------------------------------------
+SyntheticCDDB::SyntheticCDDB(const std::string& db_dir, const Params& params, uint32_t seed) :
+		m_db_dir(db_dir), m_params(params), m_seed(seed), m_num_files(0), m_next_file(0), m_written(0), m_malformed(0), m_failed(
+				0) {
+}
+
+SyntheticCDDB::~SyntheticCDDB() {
+}
+
+bool SyntheticCDDB::write(size_t num_files, size_t num_threads) {
+	Tracer::cout("writing ", num_files, " cddb files to: ", m_db_dir);
+	Tracer::_debug("seed: ", m_seed, " params: ", m_params);
+	for (auto genre : s_genres) {
+		Dir dir = Dir(m_db_dir).sub_dir(genre);
+		if (!dir.exists() && !dir.create()) {
+			Tracer::_err("failed to create diretory ", dir.path());
+			return false;
+		}
+	}
+
+	m_num_files = num_files;
+	m_next_file = 0;
+	if (num_threads > 1) {
+		Launcher launcher;
+		launcher.launch(num_threads, std::bind(&SyntheticCDDB::write_files, this));
+	}
+	else {
+		write_files();
+	}
+
+	Tracer::cout("Written CDDB files: ", m_written, " (malformed: ", m_malformed, ")");
+	if (m_failed) {
+		Tracer::cout("Failed CDDB files: ", m_failed);
+	}
+	return !Context::stopped() && m_written == m_num_files;
+}
+
+void SyntheticCDDB::write_files() {
+	Encoder encoder;
+	std::vector<double> weights(NUM_CHARSETS, 0);
+	for (auto& charset : m_params.charsets) {
+		weights[find_charset(charset.name)] += charset.weight;
+	}
+	std::discrete_distribution<size_t> charset_dist(weights.begin(), weights.end());
+	const uint32_t id_mask = mix32(m_seed);
+
+	size_t file_num;
+	while (!Context::stopped() && (file_num = m_next_file++) < m_num_files) {
+		std::seed_seq file_seed { m_seed, static_cast<uint32_t>(file_num), static_cast<uint32_t>(file_num >> 32) };
+		SyntheticAlbums::Generator rand(file_seed);
+
+		const char* genre = s_genres[SizeDistribution(0, NUM_GENRES - 1)(rand)];
+		uint32_t disc_id = mix32(static_cast<uint32_t>(file_num) ^ id_mask);
+		if (!disc_id) {
+			// 0 is not a valid cddb file name
+			disc_id = ~disc_id;
+		}
+		size_t charset = charset_dist(rand);
+		Script script = s_charsets[charset].script;
+		if (s_charsets[charset].any_script) {
+			script = static_cast<Script>(SizeDistribution(0, static_cast<size_t>(Script::CJK))(rand));
+		}
+
+		std::string content = make_content(rand, disc_id, genre, charset, script, encoder);
+		if (content.empty()) {
+			Tracer::_err("failed to convert cddb file ", file_num, " to ", s_charsets[charset].name);
+			m_failed++;
+			continue;
+		}
+		const bool malformed = SizeDistribution(0, 99)(rand) < m_params.malformed_percent;
+		if (malformed) {
+			content = make_malformed(rand, content);
+		}
+
+		char name[9];
+		::snprintf(name, sizeof(name), "%08x", disc_id);
+		const std::string path = m_db_dir + Dir::DIR_SEP + genre + Dir::DIR_SEP + name;
+		int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		bool ok = fd >= 0 && (ssize_t) content.size() == ::write(fd, content.data(), content.size());
+		int err = errno;
+		if (fd >= 0) {
+			ok = !::close(fd) && ok;
+		}
+		if (!ok) {
+			Tracer::_err("failed to write cddb file ", path, ": ", ::strerror(err));
+			m_failed++;
+			continue;
+		}
+		if (malformed) {
+			m_malformed++;
+		}
+		if (!(++m_written % 10000)) {
+			Tracer::cout("Written: ", m_written);
+		}
+	}
+}
+
+std::string SyntheticCDDB::make_content(SyntheticAlbums::Generator& rand, uint32_t disc_id, const std::string& genre,
+		size_t charset, Script script, Encoder& encoder) const {
+	const size_t num_tracks = SizeDistribution(m_params.tracks.min, m_params.tracks.max)(rand);
+	const bool various_artists = SizeDistribution(0, 9)(rand) == 0;
+
+	std::ostringstream os;
+	os << "# xmcd\n#\n# Track frame offsets:\n";
+	size_t offset = 150;
+	SizeDistribution track_frames(60 * 75, 600 * 75);
+	for (size_t i = 0; i < num_tracks; i++) {
+		os << "#\t" << offset << '\n';
+		offset += track_frames(rand);
+	}
+	os << "#\n# Disc length: " << (offset / 75) << " seconds\n#\n";
+	os << "# Revision: 0\n# Submitted via: " << PACKAGE_STRING << "\n#\n";
+	char id[9];
+	::snprintf(id, sizeof(id), "%08x", disc_id);
+	os << "DISCID=" << id << '\n';
+	const std::string artist = SyntheticAlbums::make_name(rand, m_params.name_length, script);
+	os << "DTITLE=" << (various_artists ? "Various" : artist) << " / "
+			<< SyntheticAlbums::make_name(rand, m_params.name_length, script) << '\n';
+	os << "DYEAR=" << SizeDistribution(1950, 2014)(rand) << '\n';
+	os << "DGENRE=" << static_cast<char>(::toupper(genre[0])) << genre.substr(1) << '\n';
+	for (size_t i = 0; i < num_tracks; i++) {
+		os << "TTITLE" << i << '=';
+		if (various_artists) {
+			os << SyntheticAlbums::make_name(rand, m_params.name_length, script) << " / ";
+		}
+		os << SyntheticAlbums::make_name(rand, m_params.name_length, script) << '\n';
+	}
+
+	std::string content = os.str();
+	if (!encoder.encode(charset, content)) {
+		return std::string();
+	}
+
+	std::ostringstream tail;
+	for (size_t i = 0; i < num_tracks; i++) {
+		tail << "EXTT" << i << "=\n";
+	}
+	tail << "PLAYORDER=\n";
+
+	// pad with extended disc data lines to the file size
+	const size_t size = SizeDistribution(m_params.size.min, m_params.size.max)(rand);
+	const size_t line_len = 70;
+	content += "EXTD=\n";
+	while (content.size() + tail.str().size() + line_len < size) {
+		content += "EXTD=";
+		for (size_t i = 0; i < line_len - 6; i++) {
+			content += static_cast<char>('a' + SizeDistribution(0, 25)(rand));
+		}
+		content += '\n';
+	}
+	return content + tail.str();
+}
+
+std::string SyntheticCDDB::make_malformed(SyntheticAlbums::Generator& rand, const std::string& content) const {
+	switch (SizeDistribution(0, 3)(rand)) {
+	case 0:
+		// empty file
+		return std::string();
+	case 1:
+		// truncated after the disc id, missing the required keywords
+		return content.substr(0, content.find("DTITLE="));
+	case 2: {
+		// no tracks
+		auto begin = content.find("TTITLE0=");
+		auto end = content.find("EXTD=");
+		return content.substr(0, begin) + content.substr(end);
+	}
+	default: {
+		// binary garbage
+		std::string garbage(content.size(), '\0');
+		for (auto& c : garbage) {
+			c = static_cast<char>(SizeDistribution(0, 255)(rand));
+		}
+		return garbage;
+	}
+	}
+}
+
+} /* namespace FMF */
@@ -0,0 +1,110 @@
+/*
+ * SyntheticCDDB.h
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#ifndef SYNTHETICCDDB_H_
+#define SYNTHETICCDDB_H_
+
+#include "SyntheticAlbums.h"
+
+#include <stddef.h>
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace FMF {
+
+/**
+ * writes a freedb shaped directory of generated xmcd files, for testing at scale without a freedb download.
+ *
+ * the cddb has a sub dir for each of the 11 freedb genres with %08x named files.
+ * file number k is a function of the seed and k only, so the cddb does not depend on the number of threads.
+ */
+class SyntheticCDDB {
+public:
+	/**
+	 * generation parameters, set by option --make-cddb=<key>=<value>,...
+	 */
+	struct Params {
+		Params();
+
+		/**
+		 * parse a comma separated list of key=value
+		 *
+		 * @return false if @e spec is invalid
+		 */
+		bool parse(const std::string& spec);
+
+		/**
+		 * charset of a file and its weight in the charsets mix
+		 */
+		struct Charset {
+			std::string name;
+			size_t weight;
+		};
+
+		std::vector<Charset> charsets;
+		SyntheticAlbums::Range tracks;
+		/// file sizes in bytes, files are padded with extended data up to the size
+		SyntheticAlbums::Range size;
+		SyntheticAlbums::Range name_length;
+		/// percent of files that fail parsing
+		size_t malformed_percent;
+	};
+
+	SyntheticCDDB(const std::string& db_dir, const Params& params, uint32_t seed);
+	~SyntheticCDDB();
+
+	/**
+	 * write @e num_files cddb files using @e num_threads threads
+	 *
+	 * @return true if all files were written
+	 */
+	bool write(size_t num_files, size_t num_threads);
+
+	friend std::ostream& operator<<(std::ostream& os, const Params& params);
+
+private:
+	class Encoder;
+
+	void write_files();
+
+	/**
+	 * @return xmcd content in charset s_charsets[@e charset], empty if conversion failed
+	 */
+	std::string make_content(SyntheticAlbums::Generator& rand, uint32_t disc_id, const std::string& genre,
+			size_t charset, SyntheticAlbums::Script script, Encoder& encoder) const;
+
+	std::string make_malformed(SyntheticAlbums::Generator& rand, const std::string& content) const;
+
+	const std::string m_db_dir;
+	const Params m_params;
+	const uint32_t m_seed;
+	size_t m_num_files;
+	std::atomic<size_t> m_next_file;
+	std::atomic<size_t> m_written;
+	std::atomic<size_t> m_malformed;
+	std::atomic<size_t> m_failed;
+};
+
+} /* namespace FMF */
+#endif /* SYNTHETICCDDB_H_ */
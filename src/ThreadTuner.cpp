@@ -0,0 +1,139 @@
+/*
+ * ThreadTuner.cpp
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#include "ThreadTuner.h"
+#include "Context.h"
+#include "Tracer.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+namespace FMF {
+
+/*static*/const std::chrono::milliseconds ThreadTuner::WINDOW(500);
+/*static*/const double ThreadTuner::TOLERANCE = 0.05;
+
+ThreadTuner::ThreadTuner(Context& ctx, size_t max_threads) :
+		m_context(ctx), m_max_threads(max_threads), m_active(
+				std::min<size_t>(max_threads, std::max(1U, std::thread::hardware_concurrency()))), m_lock(), m_cond(), m_stopped(
+				false), m_thread(), m_rate_sums(max_threads + 1), m_windows(max_threads + 1) {
+}
+
+ThreadTuner::~ThreadTuner() {
+	stop();
+	if (m_thread.joinable()) {
+		m_thread.join();
+	}
+}
+
+void ThreadTuner::start() {
+	m_thread = std::thread(&ThreadTuner::run, this);
+}
+
+void ThreadTuner::stop() {
+	{
+		std::lock_guard < std::mutex > locker(m_lock);
+		m_stopped = true;
+	}
+	m_cond.notify_all();
+}
+
+void ThreadTuner::wait_active(size_t index) {
+	if (index < m_active)
+		return;
+	std::unique_lock < std::mutex > lock(m_lock);
+	// signals do not notify, Context::stopped() is polled
+	while (!m_stopped && index >= m_active && !Context::stopped()) {
+		m_cond.wait_for(lock, WINDOW);
+	}
+}
+
+void ThreadTuner::run() {
+	auto last_time = std::chrono::steady_clock::now();
+	size_t last_files = m_context.create_success_count();
+	double last_rate = 0;
+	int direction = 1;
+	std::unique_lock < std::mutex > lock(m_lock);
+	while (!m_stopped && !Context::stopped()) {
+		m_cond.wait_for(lock, WINDOW);
+		if (m_stopped)
+			break;
+		auto now = std::chrono::steady_clock::now();
+		const size_t files = m_context.create_success_count();
+		const double rate = (files - last_files) / std::chrono::duration<double>(now - last_time).count();
+		last_time = now;
+		last_files = files;
+
+		const size_t active = m_active;
+		m_rate_sums[active] += rate;
+		m_windows[active]++;
+		if (rate < last_rate * (1 - TOLERANCE)) {
+			// the last step lowered the rate
+			direction = -direction;
+		}
+		last_rate = rate;
+
+		const size_t step = std::max<size_t>(1, active / 4);
+		const size_t up = std::min(m_max_threads, active + step);
+		const size_t down = (active > step) ? active - step : 1;
+		if ((direction > 0 ? up : down) == active) {
+			// at a bound
+			direction = -direction;
+		}
+		const size_t next = (direction > 0) ? up : down;
+		Tracer::_debug("threads ", active, ": ", rate, " files/s, next ", next);
+		m_active = next;
+		m_cond.notify_all();
+	}
+}
+
+size_t ThreadTuner::best_threads() const {
+	std::lock_guard < std::mutex > locker(m_lock);
+	size_t best = 0;
+	double best_rate = -1;
+	for (size_t n = 1; n <= m_max_threads; n++) {
+		if (m_windows[n] && m_rate_sums[n] / m_windows[n] > best_rate) {
+			best_rate = m_rate_sums[n] / m_windows[n];
+			best = n;
+		}
+	}
+	return best;
+}
+
+void ThreadTuner::report() const {
+	const size_t best = best_threads();
+	if (!best) {
+		Tracer::cout("Threads: auto, the run was too short to measure, ", m_active.load(), " threads ran");
+		return;
+	}
+	std::lock_guard < std::mutex > locker(m_lock);
+	char line[128];
+	::snprintf(line, sizeof(line), "Threads: auto chose %zu of max %zu, %.1f files/s", best, m_max_threads,
+			m_rate_sums[best] / m_windows[best]);
+	Tracer::cout(line);
+	for (size_t n = 1; n <= m_max_threads; n++) {
+		if (m_windows[n]) {
+			Tracer::_info("threads ", n, ": ", m_rate_sums[n] / m_windows[n], " files/s in ", m_windows[n], " windows");
+		}
+	}
+}
+
+} /* namespace FMF */
@@ -0,0 +1,101 @@
+/*
+ * ThreadTuner.h
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#ifndef THREADTUNER_H_
+#define THREADTUNER_H_
+
+#include <stddef.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace FMF {
+
+class Context;
+
+/**
+ * tunes the number of active generator threads at run time, set by option --threads=auto.
+ *
+ * all the threads are launched, the threads with an index from the number of active threads up wait in
+ * wait_active() before their next album. every WINDOW the files per second of the window are measured and the
+ * number of active threads is moved by a step in the same direction, or in the other direction if the rate dropped
+ * by more than TOLERANCE (hill climbing). the number of threads with the highest mean rate is the chosen one.
+ */
+class ThreadTuner {
+public:
+	/**
+	 * @param max_threads	number of launched threads
+	 */
+	ThreadTuner(Context& ctx, size_t max_threads);
+	~ThreadTuner();
+
+	/**
+	 * start tuning in a thread
+	 */
+	void start();
+
+	/**
+	 * stop tuning and let all the waiting threads run, called when there are no more albums. the tuning thread is
+	 * joined at destruction
+	 */
+	void stop();
+
+	/**
+	 * wait until the thread @e index is active, or tuning is stopped
+	 */
+	void wait_active(size_t index);
+
+	/**
+	 * @return the number of threads with the highest mean rate, 0 if none was measured
+	 */
+	size_t best_threads() const;
+
+	/**
+	 * output the rate of each number of threads that was measured
+	 */
+	void report() const;
+
+private:
+	ThreadTuner(const ThreadTuner&) = delete;
+	ThreadTuner& operator=(const ThreadTuner&) = delete;
+
+	void run();
+
+	static const std::chrono::milliseconds WINDOW;
+	static const double TOLERANCE;
+
+	Context& m_context;
+	const size_t m_max_threads;
+	std::atomic<size_t> m_active;
+	mutable std::mutex m_lock;
+	std::condition_variable m_cond;
+	bool m_stopped;
+	std::thread m_thread;
+	/// sum of the rates and number of windows by number of active threads
+	std::vector<double> m_rate_sums;
+	std::vector<size_t> m_windows;
+};
+
+} /* namespace FMF */
+#endif /* THREADTUNER_H_ */
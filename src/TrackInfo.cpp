@@ -34,7 +34,8 @@ TrackInfo::TrackInfo() :
 		m_comment(),
 		m_year(0),
 		m_track_num(0),
-		m_tracks_total(0) {
+		m_tracks_total(0),
+		m_duration_ms(0) {
 }
 
 bool TrackInfo::validate() const {
@@ -51,6 +52,7 @@ std::ostream& operator <<(std::ostream& os, const TrackInfo& ti) {
 	os << "comment: " << ti.m_comment << std::endl;
 	os << "year: " << ti.m_year << std::endl;
 	os << "track#: " << ti.m_track_num << '/' << ti.m_tracks_total << std::endl;
+	os << "duration: " << ti.m_duration_ms << "ms" << std::endl;
 	return os;
 }
 } /* namespace fmf */
@@ -83,6 +83,10 @@ public:
 		m_year = year;
 	}
 
+	void set_duration_ms(size_t duration_ms) {
+		m_duration_ms = duration_ms;
+	}
+
 	std::string album() const {
 		return m_album;
 	}
@@ -123,6 +127,13 @@ public:
 		return m_year;
 	}
 
+	/**
+	 * @return the track duration in milliseconds, 0 if unknown
+	 */
+	size_t duration_ms() const {
+		return m_duration_ms;
+	}
+
 private:
 	std::string m_db_file;
 	std::string m_album_artist;
@@ -134,6 +145,7 @@ private:
 	size_t m_year;
 	size_t m_track_num;
 	size_t m_tracks_total;
+	size_t m_duration_ms;
 };
 
 } /* namespace fmf */
@@ -0,0 +1,268 @@
+/*
+ * VirtualLibrary.cpp
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#include "VirtualLibrary.h"
+#include "config.h"
+#include "Dir.h"
+#include "MusicFileCreator.h"
+#include "Tracer.h"
+
+#ifdef HAVE_FUSE
+#define FUSE_USE_VERSION 31
+#include <fuse.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <utility>
+
+namespace FMF {
+
+static const size_t ID3V1_SIZE = 128;
+
+/**
+ * @return size of the id3v1 tag at the end of @e data, 0 if none
+ */
+static size_t id3v1_size(const char* data, size_t size) {
+	return (size >= ID3V1_SIZE && ::memcmp(data + size - ID3V1_SIZE, "TAG", 3) == 0) ? ID3V1_SIZE : 0;
+}
+
+//-----------------------------------------------------------------------------
+// VirtualLibrary::Rendering
+//-----------------------------------------------------------------------------
+VirtualLibrary::Rendering::Rendering(const std::string& data, const std::vector<char>& templ) :
+		head(), body(templ.data()), body_size(0), tail() {
+	// tagging rewrites the tags at the start and the id3v1 tag at the end, the audio in between is the template's
+	const size_t data_end = data.size() - id3v1_size(data.data(), data.size());
+	const size_t templ_end = templ.size() - id3v1_size(templ.data(), templ.size());
+	const size_t max_body_size = std::min(data_end, templ_end);
+	while (body_size < max_body_size && data[data_end - body_size - 1] == templ[templ_end - body_size - 1]) {
+		body_size++;
+	}
+	body = templ.data() + templ_end - body_size;
+	head = data.substr(0, data_end - body_size);
+	tail = data.substr(data_end);
+}
+
+size_t VirtualLibrary::Rendering::read(char* buf, size_t len, size_t offset) const {
+	const std::pair<const char*, size_t> parts[] = { { head.data(), head.size() }, { body, body_size }, { tail.data(),
+																										tail.size() } };
+	size_t done = 0;
+	for (auto& part : parts) {
+		if (offset >= part.second) {
+			offset -= part.second;
+			continue;
+		}
+		const size_t n = std::min(part.second - offset, len - done);
+		::memcpy(buf + done, part.first + offset, n);
+		done += n;
+		offset = 0;
+	}
+	return done;
+}
+
+#ifdef HAVE_FUSE
+//-----------------------------------------------------------------------------
+// fuse operations
+//-----------------------------------------------------------------------------
+static VirtualLibrary* library() {
+	return static_cast<VirtualLibrary*>(::fuse_get_context()->private_data);
+}
+
+static int fmf_getattr(const char* path, struct stat* st, struct fuse_file_info*) {
+	const VirtualLibrary::Node* node = library()->find(path);
+	return node ? library()->stat(*node, *st) : -ENOENT;
+}
+
+static int fmf_readdir(const char* path, void* buf, fuse_fill_dir_t filler, off_t, struct fuse_file_info*,
+		enum fuse_readdir_flags) {
+	const VirtualLibrary::Node* node = library()->find(path);
+	if (!node)
+		return -ENOENT;
+	if (node->track != VirtualLibrary::NO_TRACK)
+		return -ENOTDIR;
+	const fuse_fill_dir_flags flags = static_cast<fuse_fill_dir_flags>(0);
+	filler(buf, ".", nullptr, 0, flags);
+	filler(buf, "..", nullptr, 0, flags);
+	for (auto& name : node->entries) {
+		filler(buf, name.c_str(), nullptr, 0, flags);
+	}
+	return 0;
+}
+
+static int fmf_open(const char* path, struct fuse_file_info* fi) {
+	const VirtualLibrary::Node* node = library()->find(path);
+	if (!node)
+		return -ENOENT;
+	if (node->track == VirtualLibrary::NO_TRACK)
+		return -EISDIR;
+	if ((fi->flags & O_ACCMODE) != O_RDONLY)
+		return -EROFS;
+	// the content of a file never changes
+	fi->fh = node->track;
+	fi->keep_cache = 1;
+	return 0;
+}
+
+static int fmf_read(const char*, char* buf, size_t size, off_t offset, struct fuse_file_info* fi) {
+	return library()->read(fi->fh, buf, size, offset);
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// VirtualLibrary
+//-----------------------------------------------------------------------------
+VirtualLibrary::VirtualLibrary(MusicFileCreator& creator) :
+		m_creator(creator), m_mtime(::time(nullptr)), m_nodes_lock(), m_nodes { { "/", Node { NO_TRACK, { } } } }, m_tracks(),
+		m_renderings_lock(), m_sizes(), m_renderings(), m_rendering_index() {
+}
+
+VirtualLibrary::~VirtualLibrary() {
+}
+
+bool VirtualLibrary::add(const std::string& path, const TrackInfo& ti) {
+	std::lock_guard < std::mutex > locker(m_nodes_lock);
+	std::string node_path = Dir::DIR_SEP + path;
+	if (!m_nodes.emplace(node_path, Node { m_tracks.size(), { } }).second)
+		return false;
+	m_tracks.push_back(ti);
+	m_sizes.push_back(0);
+
+	// add the entry to its parent dirs, up to the first dir that exists
+	bool is_new = true;
+	while (is_new) {
+		auto pos = node_path.rfind(Dir::DIR_SEP);
+		std::string parent_path = pos ? node_path.substr(0, pos) : std::string(1, Dir::DIR_SEP);
+		auto res = m_nodes.emplace(parent_path, Node { NO_TRACK, { } });
+		res.first->second.entries.push_back(node_path.substr(pos + 1));
+		is_new = res.second;
+		node_path = parent_path;
+	}
+	return true;
+}
+
+const VirtualLibrary::Node* VirtualLibrary::find(const std::string& path) const {
+	// nodes are only added before the library is mounted
+	auto it = m_nodes.find(path);
+	return (it == m_nodes.end()) ? nullptr : &it->second;
+}
+
+int VirtualLibrary::stat(const Node& node, struct stat& st) {
+	::memset(&st, 0, sizeof(st));
+	st.st_uid = ::getuid();
+	st.st_gid = ::getgid();
+	st.st_atime = st.st_mtime = st.st_ctime = m_mtime;
+	if (node.track == NO_TRACK) {
+		st.st_mode = S_IFDIR | 0555;
+		st.st_nlink = 2;
+		return 0;
+	}
+	size_t size;
+	{
+		std::lock_guard < std::mutex > locker(m_renderings_lock);
+		size = m_sizes[node.track];
+	}
+	if (!size) {
+		auto r = rendering(node.track);
+		if (!r)
+			return -EIO;
+		size = r->size();
+	}
+	st.st_mode = S_IFREG | 0444;
+	st.st_nlink = 1;
+	st.st_size = size;
+	return 0;
+}
+
+int VirtualLibrary::read(size_t track, char* buf, size_t len, size_t offset) {
+	if (track >= m_tracks.size())
+		return -EBADF;
+	auto r = rendering(track);
+	if (!r)
+		return -EIO;
+	return r->read(buf, len, offset);
+}
+
+std::shared_ptr<const VirtualLibrary::Rendering> VirtualLibrary::rendering(size_t track) {
+	{
+		std::lock_guard < std::mutex > locker(m_renderings_lock);
+		auto it = m_rendering_index.find(track);
+		if (it != m_rendering_index.end()) {
+			m_renderings.splice(m_renderings.begin(), m_renderings, it->second);
+			return it->second->second;
+		}
+	}
+
+	std::string data;
+	const std::vector<char>* templ = m_creator.render_music_file(m_tracks[track], data);
+	if (!templ)
+		return nullptr;
+	std::shared_ptr<const Rendering> r = std::make_shared<const Rendering>(data, *templ);
+
+	std::lock_guard < std::mutex > locker(m_renderings_lock);
+	auto it = m_rendering_index.find(track);
+	if (it != m_rendering_index.end()) {
+		// rendered by another thread meanwhile
+		return it->second->second;
+	}
+	m_renderings.emplace_front(track, r);
+	m_rendering_index[track] = m_renderings.begin();
+	m_sizes[track] = r->size();
+	if (m_renderings.size() > MAX_RENDERINGS) {
+		m_rendering_index.erase(m_renderings.back().first);
+		m_renderings.pop_back();
+	}
+	return r;
+}
+
+bool VirtualLibrary::mount(const std::string& mount_dir) {
+#ifdef HAVE_FUSE
+	struct fuse_operations ops;
+	::memset(&ops, 0, sizeof(ops));
+	ops.getattr = fmf_getattr;
+	ops.readdir = fmf_readdir;
+	ops.open = fmf_open;
+	ops.read = fmf_read;
+
+	// fuse unmounts on SIGINT, SIGHUP and SIGTERM only if their handlers are the default
+	::signal(SIGINT, SIG_DFL);
+	::signal(SIGHUP, SIG_DFL);
+	::signal(SIGTERM, SIG_DFL);
+
+	std::vector<std::string> args { PACKAGE_NAME, "-f", "-o", "ro,default_permissions,fsname=" PACKAGE_NAME, mount_dir };
+	std::vector<char*> argv;
+	for (auto& arg : args) {
+		argv.push_back(&arg[0]);
+	}
+	Tracer::cout("Serving ", m_tracks.size(), " music files at ", mount_dir, ", unmount with: fusermount3 -u ",
+			mount_dir);
+	return ::fuse_main(argv.size(), argv.data(), &ops, this) == 0;
+#else
+	Tracer::_err("can't mount ", mount_dir, ": ", PACKAGE_NAME, " was built without fuse");
+	return false;
+#endif
+}
+
+} /* namespace FMF */
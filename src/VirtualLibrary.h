@@ -0,0 +1,154 @@
+/*
+ * VirtualLibrary.h
+ *
+ * This file is part of fmf
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright 2014 GD <gd@iotide.com>
+ */
+#ifndef VIRTUALLIBRARY_H_
+#define VIRTUALLIBRARY_H_
+
+#include "TrackInfo.h"
+
+#include <stddef.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace FMF {
+
+class MusicFileCreator;
+
+/**
+ * a library of fake music files kept in memory and mounted with fuse, set by option --mount.
+ *
+ * MusicFileCreator adds the path and track info of each generated music file, nothing is written to disk, so the
+ * library is mounted without tagging any file. a file is rendered when it is first stat'ed or read, by tagging its
+ * template in memory. only the parts of the tagged file that differ from the template are kept, in an LRU of
+ * MAX_RENDERINGS files. the size of each rendered file is kept, so stat renders a file at most once.
+ */
+class VirtualLibrary {
+public:
+	/**
+	 * a music file tagged in memory: the tagged head and tail around the unchanged body of its template data
+	 */
+	struct Rendering {
+		/**
+		 * split @e data, the tagged @e templ
+		 */
+		Rendering(const std::string& data, const std::vector<char>& templ);
+
+		size_t size() const {
+			return head.size() + body_size + tail.size();
+		}
+
+		/**
+		 * copy up to @e len bytes at @e offset to @e buf
+		 *
+		 * @return number of bytes copied
+		 */
+		size_t read(char* buf, size_t len, size_t offset) const;
+
+		std::string head;
+		/// points into the template data, which lives as long as the MusicFileCreator
+		const char* body;
+		size_t body_size;
+		std::string tail;
+	};
+
+	/**
+	 * a directory or a music file, by absolute path in the library
+	 */
+	struct Node {
+		/// index of the track of a music file, NO_TRACK for a directory
+		size_t track;
+		/// names of the entries of a directory
+		std::vector<std::string> entries;
+	};
+
+	static const size_t NO_TRACK = static_cast<size_t>(-1);
+
+	VirtualLibrary(MusicFileCreator& creator);
+	~VirtualLibrary();
+
+	/**
+	 * add the music file @e path, relative to the library root, for track info @e ti
+	 *
+	 * @return false if @e path was already added
+	 */
+	bool add(const std::string& path, const TrackInfo& ti);
+
+	/**
+	 * @return the node at absolute @e path, null if not found
+	 */
+	const Node* find(const std::string& path) const;
+
+	/**
+	 * fill @e st for @e node, renders the music file if its size is not known yet
+	 *
+	 * @return 0 or -errno
+	 */
+	int stat(const Node& node, struct stat& st);
+
+	/**
+	 * read from the music file of @e track
+	 *
+	 * @return number of bytes read or -errno
+	 */
+	int read(size_t track, char* buf, size_t len, size_t offset);
+
+	size_t num_tracks() const {
+		return m_tracks.size();
+	}
+
+	/**
+	 * mount the library at @e mount_dir and serve it until it is unmounted
+	 *
+	 * @return false if fuse failed or fmf was built without fuse
+	 */
+	bool mount(const std::string& mount_dir);
+
+private:
+	typedef std::list<std::pair<size_t, std::shared_ptr<const Rendering>>> RenderingList;
+
+	/**
+	 * @return the rendering of @e track from the LRU, rendered if not found, null if rendering failed
+	 */
+	std::shared_ptr<const Rendering> rendering(size_t track);
+
+	static const size_t MAX_RENDERINGS = 4096;
+
+	MusicFileCreator& m_creator;
+	const time_t m_mtime;
+	std::mutex m_nodes_lock;
+	std::unordered_map<std::string, Node> m_nodes;
+	std::vector<TrackInfo> m_tracks;
+	std::mutex m_renderings_lock;
+	/// size of the music file of each track once rendered, 0 before
+	std::vector<size_t> m_sizes;
+	/// most recently used first
+	RenderingList m_renderings;
+	std::unordered_map<size_t, RenderingList::iterator> m_rendering_index;
+};
+
+} /* namespace FMF */
+#endif /* VIRTUALLIBRARY_H_ */
@@ -19,24 +19,36 @@
  *
  * Copyright 2014 GD <gd@iotide.com>
  */
+#include "ArchiveWriter.h"
+#include "Benchmark.h"
 #include "Context.h"
+#include "Daemon.h"
 #include "Launcher.h"
 #include "MusicFileCreator.h"
 #include "MusicFilesGenerator.h"
 #include "Options.h"
+#include "SyntheticCDDB.h"
+#include "ThreadTuner.h"
 #include "Tracer.h"
+#include "VirtualLibrary.h"
 
+using FMF::ArchiveWriter;
+using FMF::Benchmark;
 using FMF::Context;
+using FMF::Daemon;
 using FMF::Launcher;
 using FMF::MusicFilesGenerator;
 using FMF::MusicFileCreator;
 using FMF::Options;
+using FMF::SyntheticCDDB;
+using FMF::ThreadTuner;
 using FMF::Tracer;
 
 #include <cstdlib>
 #include <stdlib.h>
 #include <iostream>
 #include <future>
+#include <memory>
 #include <signal.h>
 
 void sig_handler(int /*sig*/) {
@@ -61,7 +73,27 @@ int main(int argc, char** argv) {
 	Options opts;
 
 	if (!opts.parse(argc, argv))
-		return EXIT_FAILURE;
+		return opts.is_info_requested() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	if (opts.is_archive_set() && opts.archive_file() == ArchiveWriter::STDOUT_PATH) {
+		// stdout is the archive, messages go to stderr
+		std::cout.rdbuf(std::cerr.rdbuf());
+	}
+
+	if (opts.is_make_cddb_set()) {
+		SyntheticCDDB cddb(opts.db_dir(), opts.make_cddb_params(), opts.seed());
+		return cddb.write(opts.num_albums(), opts.num_threads()) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (opts.is_benchmark_set()) {
+		Benchmark benchmark(opts);
+		return benchmark.run() ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (opts.is_daemon_set()) {
+		Daemon daemon(opts);
+		return daemon.run() ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
 
 	Context ctx(opts);
 
@@ -78,16 +110,36 @@ int main(int argc, char** argv) {
 
 	MusicFilesGenerator generator(ctx);
 
-	if (opts.num_threads() > 1) {
-		Launcher launcher;
+	std::unique_ptr<ThreadTuner> tuner;
+	if (opts.is_auto_threads()) {
+		tuner.reset(new ThreadTuner(ctx, opts.num_threads()));
+		generator.set_tuner(tuner.get());
+		tuner->start();
+	}
+
+	if (opts.num_threads() > 1 || opts.placement().is_set()) {
+		Launcher launcher(opts.placement());
 		launcher.launch(opts.num_threads(), generator, creator);
 	}
 	else {
 		generator(creator);
 	}
 
+	if (tuner) {
+		tuner->stop();
+		tuner->report();
+		ctx.set_tuned_threads(tuner->best_threads());
+	}
+
+	bool finished = creator.finish();
+
+	ctx.mark_bad_files();
 	ctx.output_summary(std::cout);
 
-	return EXIT_SUCCESS;
+	if (finished && creator.virtual_library()) {
+		finished = creator.virtual_library()->mount(opts.mount_dir());
+	}
+
+	return finished ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 